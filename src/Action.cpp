@@ -14,8 +14,8 @@ Order::Order(const int& id, const Delta& delta, const int& price) :
 
 }
 
-void Order::print() const {
-    std::cout << "BREW " << id << std::endl;
+void Order::print(std::ostream& out) const {
+    out << "BREW " << id << std::endl;
 }
 
 std::ostream& operator<<(std::ostream& out, const Order& o) {
@@ -30,8 +30,8 @@ Recipe::Recipe(const int& id, const Delta& delta,
 
 }
 
-void Recipe::print() const {
-    std::cout << "LEARN " << id << std::endl;
+void Recipe::print(std::ostream& out) const {
+    out << "LEARN " << id << std::endl;
 }
 
 std::ostream& operator<<(std::ostream& out, const Recipe& r) {
@@ -75,9 +75,9 @@ Spell::Spell(const Recipe& recipe) :
 
 }
 
-void Spell::print() const {
+void Spell::print(std::ostream& out) const {
     assert(curTimes >= 1);
-    std::cout << "CAST " << id << " " << curTimes << std::endl;
+    out << "CAST " << id << " " << curTimes << std::endl;
 }
 
 std::ostream& operator<<(std::ostream& out, const Spell& s) {
@@ -87,8 +87,8 @@ std::ostream& operator<<(std::ostream& out, const Spell& s) {
         << "maxTimes=" << s.maxTimes;
 }
 
-void Rest::print() const {
-    std::cout << "REST" << std::endl;
+void Rest::print(std::ostream& out) const {
+    out << "REST" << std::endl;
 }
 
 std::istream& operator>>(std::istream& in, Witch& w) {
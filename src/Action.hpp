@@ -12,7 +12,7 @@ struct Action {
     Action() = default;
     Action(const int& id, const Delta& delta);
 
-    virtual void print() const = 0;
+    virtual void print(std::ostream& out) const = 0;
     virtual ~Action() = default;
 };
 
@@ -21,7 +21,7 @@ struct Order : public Action {
 
     Order() = default;
     Order(const int& id, const Delta& delta, const int& price);
-    void print() const override;
+    void print(std::ostream& out) const override;
 
     friend std::ostream& operator<<(std::ostream& out, const Order& o);
 };
@@ -34,7 +34,7 @@ struct Recipe : public Action {
     Recipe() = default;
     Recipe(const int& id, const Delta& delta,
         const int &tomeIndex, const int& taxCount, const bool& repeatable);
-    void print() const override;
+    void print(std::ostream& out) const override;
 
     friend std::ostream& operator<<(std::ostream& out, const Recipe& r);
 };
@@ -52,14 +52,14 @@ struct Spell : public Action {
     Spell(const int& id, const Delta& delta,
         const bool& castable, const bool& repeatable);
     Spell(const Recipe& recipe);
-    void print() const override;
+    void print(std::ostream& out) const override;
 
     friend std::ostream& operator<<(std::ostream& out, const Spell& s);
 };
 
 struct Rest : public Action {
 	Rest() = default;
-    void print() const override;
+    void print(std::ostream& out) const override;
 };
 
 struct Witch {
@@ -0,0 +1,40 @@
+#include "Beam.hpp"
+
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+
+Beam::~Beam() {
+    std::free(block);
+}
+
+void Beam::reserve(const int& capacity) {
+    if (capacity <= size)
+        return;
+
+    auto arraySize = [capacity](const size_t& fieldSize) {
+        return (capacity * fieldSize + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    };
+    size_t total = arraySize(sizeof(State)) + arraySize(sizeof(uint64_t)) +
+        arraySize(sizeof(eval_t));
+
+    std::free(block);
+    block = std::aligned_alloc(ALIGNMENT, total);
+    if (!block)
+        throw std::bad_alloc();
+    size = capacity;
+
+    char* next = static_cast<char*>(block);
+    auto carve = [&](auto*& array) {
+        using T = std::remove_reference_t<decltype(*array)>;
+        array = reinterpret_cast<T*>(next);
+        next += arraySize(sizeof(T));
+    };
+    carve(states);
+    carve(keys);
+    carve(evaluations);
+}
+
+int Beam::capacity() const {
+    return size;
+}
@@ -0,0 +1,43 @@
+#ifndef BEAM_HPP
+#define BEAM_HPP
+
+#include "SearchEngine.hpp"
+
+#include <cstdint>
+
+// A layer of states with the fields deduplication scans, the key and the
+// evaluation, also kept in arrays of their own, every array aligned to a
+// cache line. Only the survivors of a layer are read as whole states.
+class Beam {
+public:
+    static constexpr int ALIGNMENT = 64;
+
+    Beam() = default;
+    Beam(const Beam&) = delete;
+    Beam& operator=(const Beam&) = delete;
+    ~Beam();
+
+    // Keeps the contents only if capacity is already enough.
+    void reserve(const int& capacity);
+    int capacity() const;
+
+    // Fills the scanned fields of states [begin, begin + count) from them.
+    inline void index(const int& begin, const int& count);
+
+    State* states = nullptr;
+    uint64_t* keys = nullptr;
+    eval_t* evaluations = nullptr;
+
+private:
+    void* block = nullptr;
+    int size = 0;
+};
+
+void Beam::index(const int& begin, const int& count) {
+    for (int i = begin; i < begin + count; ++i) {
+        keys[i] = states[i].key();
+        evaluations[i] = states[i].evaluation;
+    }
+}
+
+#endif /* BEAM_HPP */
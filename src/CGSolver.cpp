@@ -1,163 +1,557 @@
-#define DEBUG
+// Generated by amalgamate from: SearchEngine.cpp Beam.cpp Common.cpp Delta.cpp DeltaBatch.cpp Action.cpp Inventory.cpp Log.cpp Mcts.cpp Options.cpp Reader.cpp Snapshot.cpp Stats.cpp TranspositionTable.cpp WorkerPool.cpp main.cpp
+#pragma GCC optimize("O3,inline,omit-frame-pointer")
+#define NDEBUG
+#define LOG_LEVEL LOG_OFF
+
+// Log.hpp
+
+#include <cstddef>
+#include <ostream>
+
+// Diagnostics that stay out of the turn budget. A call formats its
+// message into a fixed slot of a lock-free ring and returns; nothing is
+// written until flush(), which the agent calls once the action is out.
+// A message that finds the ring full is dropped and counted, so logging
+// never blocks or allocates inside a search.
+//
+// Levels are picked at compile time with LOG_LEVEL. Calls above it
+// expand to nothing, arguments included. It defaults to LOG_DEBUG in
+// DEBUG builds, the submitted merge included, and to LOG_OFF otherwise.
+#define LOG_OFF 0
+#define LOG_ERROR 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3
+
+#ifndef LOG_LEVEL
+#ifdef DEBUG
+#define LOG_LEVEL LOG_DEBUG
+#else
+#define LOG_LEVEL LOG_OFF
+#endif
+#endif
 
+namespace Log {
+    constexpr int SLOT_COUNT = 256;
+    constexpr int SLOT_SIZE = 2048;
 
-#include <iostream>
-#include <chrono>
+    // Copies text into the ring as one message, cut to SLOT_SIZE.
+    void append(const char* text, const size_t& length);
+    // Writes out every message queued so far, in order, to stderr.
+    void flush();
 
-using eval_t = float;
+    // The stream messages are formatted into: the calling thread's own,
+    // over a buffer of SLOT_SIZE bytes that is cleared on every call.
+    std::ostream& begin();
+    void end();
 
-constexpr int INF = 1e9;
+    inline void names(std::ostream& out, const char* s, const char*) {
+        out << s << ": ";
+    }
 
-#define low(x) ((x) & (-(x))) // lowest bit
-#define bits(x) (31 - __builtin_clz(x)) // floor(log2(x))
+    template<typename T>
+    void names(std::ostream& out, const char* s, const T& x) {
+        out << s << ": " << x << " ";
+    }
 
-#if defined(LOCAL) && !defined(NDEBUG)
-#define DEBUG
+    // Prints every argument after its own expression, splitting the
+    // stringified argument list on the commas outside brackets.
+    template<typename T, typename... Args>
+    void names(std::ostream& out, const char* s, const T& x, const Args&... rest) {
+        int bracket = 0;
+        char c;
+        while ((c = *s) != ',' || bracket)
+        {
+            out << *s++;
+            switch (c)
+            {
+                case '(':
+                case '{':
+                case '[':
+                    ++bracket;
+                    break;
+                case ')':
+                case '}':
+                case ']':
+                    --bracket;
+            }
+        }
+        out << ": ";
+        out << x << ",";
+        names(out, s + 1, rest...);
+    }
+
+    template<typename... Args>
+    void write(const char* s, const Args&... rest) {
+        std::ostream& out = begin();
+        names(out, s, rest...);
+        out << '\n';
+        end();
+    }
+}
+
+#define LOG_WRITE(...) Log::write(#__VA_ARGS__, __VA_ARGS__)
+
+#if LOG_LEVEL >= LOG_ERROR
+#define logError(...) LOG_WRITE(__VA_ARGS__)
+#else
+#define logError(...) ((void)0)
 #endif
 
-#ifdef DEBUG
+#if LOG_LEVEL >= LOG_INFO
+#define logInfo(...) LOG_WRITE(__VA_ARGS__)
+#else
+#define logInfo(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_DEBUG
+#define debug(...) LOG_WRITE(__VA_ARGS__)
+#else
+#define debug(...) ((void)0)
+#endif
 
-inline void __debug(const char* s, const char*) {
-    std::cerr << s << ": ";
+
+// Options.hpp
+
+#include <array>
+#include <iostream>
+
+// Search parameters. DEFAULTS are compiled in and the search has a copy
+// specialised for them, with every parameter a constant. A parameter
+// file or WITCH_<NAME> environment variables can override them in params;
+// an engine given parameters that differ from DEFAULTS reads them at run
+// time instead.
+namespace Options {
+	extern int enemyOrdersDone;
+
+	constexpr int MAX_NEAR_ORDER_DISTANCE = 16;
+
+	struct Params {
+		float decay = 0.97f;
+		float learnDecay = 0.6f;
+		float nearOrderWeight = 0.5f;
+		float rivalDiscount = 0.5f;
+		float lastOrderBonus = 1e4f;
+		float castableValue = 0.01f;
+		float exploration = 1.4f;
+		int beamWidth = 2000;
+
+		// nearOrderWeight * decay^(d + 1) for an order d casts away
+		std::array<float, MAX_NEAR_ORDER_DISTANCE + 1> nearOrderDecay{};
+
+		constexpr void derive() {
+			nearOrderDecay[0] = nearOrderWeight * decay;
+			for (int d = 1; d <= MAX_NEAR_ORDER_DISTANCE; ++d)
+				nearOrderDecay[d] = nearOrderDecay[d - 1] * decay;
+		}
+	};
+
+	constexpr Params derived(Params p) {
+		p.derive();
+		return p;
+	}
+
+	constexpr Params DEFAULTS = derived(Params());
+
+	extern Params params;
+
+	// Where the search takes its parameters from, given its own.
+	struct Compiled {
+		static constexpr const Params& get(const Params&) { return DEFAULTS; }
+	};
+	struct Runtime {
+		static const Params& get(const Params& own) { return own; }
+	};
+
+	// Each returns false, naming the problem on stderr, if something
+	// couldn't be used. None of them takes effect before update().
+	bool set(const char* name, const char* value);
+	bool loadFile(const char* path);
+	bool loadEnvironment();
+	void update();
+
+	// Whether Compiled can stand in for p: it may differ from DEFAULTS
+	// only where the search reads its own copy, like beamWidth.
+	bool isDefault(const Params& p);
+	void print(std::ostream& out);
 }
 
-template<typename T>
-void __debug(const char* s, const T& x) {
-    std::cerr << s << ": " << x << " ";
+
+// Reader.hpp
+
+// Whitespace separated tokenizer over a file descriptor or a buffer in
+// memory. Reading from a descriptor refills a fixed buffer with whatever
+// read() returns, so it works on an interactive pipe and never allocates.
+class Reader {
+public:
+    explicit Reader(const int& fd);
+    Reader(const char* begin, const char* end);
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    // True once only whitespace is left.
+    bool eof();
+    int readInt();
+    // Skips the next word and returns its first character.
+    char readKeyword();
+
+private:
+    inline bool fill();
+    bool refill();
+    void skipWhitespace();
+
+    static constexpr int BUFFER_SIZE = 1 << 16;
+
+    int fd;
+    const char* pos;
+    const char* end;
+    char buffer[BUFFER_SIZE];
+};
+
+bool Reader::fill() {
+    return pos != end || refill();
 }
 
-template<typename T, typename... Args>
-void __debug(const char* s, const T& x, const Args&... rest) {
-    int bracket = 0;
-    char c;
-    while ((c = *s) != ',' || bracket)
-    {
-        std::cerr << *s++;
-        switch (c)
-        {
-            case '(':
-            case '{':
-            case '[':
-                ++bracket;
-                break;
-            case ')':
-            case '}':
-            case ']':
-                --bracket;
+
+// Stats.hpp
+
+#include <chrono>
+#include <cstdint>
+
+// Counters and scoped timers on the hot paths, only built in with -DSTATS
+// (make stats). Anywhere else STATS_COUNT and STATS_TIME expand to
+// nothing, so release code doesn't pay for them.
+//
+// Every thread counts into its own slots; collect() adds up and clears
+// those of all threads, so it must run while no search does, between two
+// turns.
+namespace Stats {
+    enum Counter {
+        NEIGHBOR_CALLS,
+        NEIGHBORS,
+        LEGALITY_CHECKS,
+        SELECTIONS,
+        COUNTER_COUNT
+    };
+
+    enum Phase {
+        PARSE,
+        EXPAND,
+        SELECT,
+        PHASE_COUNT
+    };
+
+#ifdef STATS
+    struct Counters {
+        uint64_t counts[COUNTER_COUNT] = {};
+        uint64_t ns[PHASE_COUNT] = {};
+
+        Counters& operator+=(const Counters& o);
+    };
+
+    Counters& local();
+    Counters collect();
+    // One line to the log: the search totals given and every counter.
+    void report(const int& round, const long long& expanded, const int& depth);
+
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(const Phase& phase) :
+            phase(phase), start(std::chrono::steady_clock::now()) {
+
+        }
+
+        ~ScopedTimer() {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start);
+            local().ns[phase] += ns.count();
         }
-    }
-    std::cerr << ": ";
-    std::cerr << x << ",";
-    __debug(s + 1, rest...);
 
+    private:
+        Phase phase;
+        std::chrono::time_point<std::chrono::steady_clock> start;
+    };
+#endif
 }
 
-template<typename... Args>
-void _debug(const char* s, const Args&... rest) {
-    __debug(s, rest...);
-    std::cerr << std::endl;
+#ifdef STATS
+#define STATS_CONCAT_(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_(a, b)
+#define STATS_COUNT(counter, n) (Stats::local().counts[Stats::counter] += (n))
+#define STATS_TIME(phase) Stats::ScopedTimer STATS_CONCAT(statsTimer, __LINE__)(Stats::phase)
+#else
+#define STATS_COUNT(counter, n) ((void)0)
+#define STATS_TIME(phase) ((void)0)
+#endif
+
+
+// TranspositionTable.hpp
+
+#include <cstdint>
+#include <vector>
+
+// Open-addressing map from a state key to the index of the state kept for
+// it in the current beam layer. Entries are tagged with a generation
+// number, so starting a new layer doesn't need to clear the table.
+class TranspositionTable {
+public:
+    // Makes room for at least size keys at a load factor of at most 1/2.
+    void reserve(const int& size);
+    void clear();
+    // Returns the index stored for key, or stores index and returns -1.
+    inline int findOrInsert(const uint64_t& key, const int& index);
+
+private:
+    struct Entry {
+        uint64_t key;
+        uint32_t generation;
+        int index;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t mask = 0;
+    int shift = 64;
+    uint32_t generation = 1;
+};
+
+int TranspositionTable::findOrInsert(const uint64_t& key, const int& index) {
+    uint64_t pos = (key * 0x9e3779b97f4a7c15ull) >> shift;
+    while (true) {
+        auto& entry = entries[pos];
+        if (entry.generation != generation) {
+            entry.key = key;
+            entry.generation = generation;
+            entry.index = index;
+            return -1;
+        }
+        if (entry.key == key)
+            return entry.index;
+        pos = (pos + 1) & mask;
+    }
 }
 
-#define debug(...) _debug(#__VA_ARGS__, __VA_ARGS__)
+
+// WorkerPool.hpp
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads that run the same job side by side. The thread
+// calling run() takes part as worker 0, so a pool of size 1 has no
+// threads at all.
+class WorkerPool {
+public:
+    WorkerPool() = default;
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    ~WorkerPool();
+
+    void resize(const int& workerCount);
+    int size() const;
+
+    // Calls job(worker) once for every worker and waits for all of them.
+    void run(const std::function<void(int)>& job);
+
+private:
+    void stop();
+    void work(const int& worker, uint64_t seen);
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(int)>* job = nullptr;
+    uint64_t round = 0;
+    int pending = 0;
+    bool stopping = false;
+};
+
+
+// Common.hpp
+
+
+#include <iostream>
+#include <chrono>
+
+using eval_t = float;
+
+constexpr int INF = 1e9;
+
+#define low(x) ((x) & (-(x))) // lowest bit
+#define bits(x) (31 - __builtin_clz(x)) // floor(log2(x))
+
+#if defined(LOCAL) && !defined(NDEBUG)
+#define DEBUG
+#endif
+
+
+// Builds a hot function once for AVX-512 and once for AVX2 hosts on top of
+// the baseline the Makefile targets (SSE4.2), and lets the loader pick
+// the best the CPU runs, so one binary is at full speed on every host.
+// Only for functions called from the file that defines them.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define MULTIVERSION __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
 #else
-#define debug(...) 13
+#define MULTIVERSION
 #endif
 
 class Timer {
 public:
+    using Clock = std::chrono::steady_clock;
+
     Timer(float timeLimit);
+    // Counts from startTime instead of from now.
+    Timer(float timeLimit, const Clock::time_point& startTime);
     bool isTimeLeft() const;
+    float elapsed() const;
+    float limit() const;
 
 private:
     float timeLimit;
-    std::chrono::time_point<std::chrono::high_resolution_clock> startTime;
+    Clock::time_point startTime;
 };
 
 
-Timer::Timer(float timeLimit) :
-	timeLimit(timeLimit), startTime(std::chrono::high_resolution_clock::now()) {
-
-}
-
-bool Timer::isTimeLeft() const {
-	auto now = std::chrono::high_resolution_clock::now();
-	return std::chrono::duration<float>(now - startTime).count() * 1000 < timeLimit;
-}
+// Delta.hpp
 
 
 #include <iostream>
+#include <cstdint>
 
-using delta_t = int;
-
+// Four ingredient counts packed into 8-bit two's complement lanes of one
+// word. The top bit of every lane is a guard bit: additions are done on
+// the low 7 bits only, so carries never cross into the neighbouring lane,
+// and a set guard bit after an addition means that lane went negative.
 struct Delta {
-    delta_t delta[4] = {0};
+    uint32_t packed = 0;
 
-    bool canApply(const Delta& d) const;
+    static constexpr uint32_t LANE_LOW = 0x7f7f7f7fu;
+    static constexpr uint32_t LANE_GUARD = 0x80808080u;
+    static constexpr uint32_t LANE_ONES = 0x01010101u;
+    static constexpr int MAX_INVENTORY = 10;
+
+    Delta() = default;
+    Delta(const int& d0, const int& d1, const int& d2, const int& d3);
+
+    inline bool canApply(const Delta& d) const;
     inline eval_t eval() const;
+    inline int sum() const;
 
-    int& operator[](const int& idx);
-    const int& operator[](const int& idx) const;
-    Delta& operator+=(const Delta& o);
+    inline int operator[](const int& idx) const;
+    inline Delta& operator+=(const Delta& o);
+    inline bool operator==(const Delta& o) const;
 
     friend std::istream& operator>>(std::istream& in, Delta& d);
     friend std::ostream& operator<<(std::ostream& out, const Delta& o);
-    friend Delta operator+(const Delta& d1, const Delta& d2);
+    friend inline Delta operator+(const Delta& d1, const Delta& d2);
+
+private:
+    static inline uint32_t add(const uint32_t& a, const uint32_t& b);
 };
 
+uint32_t Delta::add(const uint32_t& a, const uint32_t& b) {
+    return ((a & LANE_LOW) + (b & LANE_LOW)) ^ ((a ^ b) & LANE_GUARD);
+}
+
+// Lanes of the result stay within [-10, 20] as long as *this is a legal
+// inventory and d is a spell or order delta, so the byte sum can't wrap.
+bool Delta::canApply(const Delta& d) const {
+    STATS_COUNT(LEGALITY_CHECKS, 1);
+    uint32_t result = add(packed, d.packed);
+    uint32_t total = (result * LANE_ONES) >> 24;
+    return !(result & LANE_GUARD) & (total <= MAX_INVENTORY);
+}
+
 eval_t Delta::eval() const {
     eval_t value = 0;
     for (int i = 0; i < 4; ++i)
-        value += delta[i] * (i + 1);
+        value += (*this)[i] * (i + 1);
     return value;
 }
 
-
-#include <cassert>
-
-int& Delta::operator[](const int& idx) {
-    return delta[idx];
+int Delta::sum() const {
+    return (*this)[0] + (*this)[1] + (*this)[2] + (*this)[3];
 }
 
-const int& Delta::operator[](const int& idx) const {
-    return delta[idx];
+int Delta::operator[](const int& idx) const {
+    return int8_t(packed >> (8 * idx));
 }
 
 Delta& Delta::operator+=(const Delta& o) {
-    for (int i = 0; i < 4; ++i)
-        delta[i] += o[i];
+    packed = add(packed, o.packed);
     return *this;
 }
 
-bool Delta::canApply(const Delta& d) const {
-    int s = 0;
-    for (int i = 0; i < 4; ++i) {
-        int diff = delta[i] + d[i];
-        if (diff < 0)
-            return false;
-        s += diff;
-    }
-    assert(s >= 0);
-    return s <= 10; 
+bool Delta::operator==(const Delta& o) const {
+    return packed == o.packed;
 }
 
-std::istream& operator>>(std::istream& in, Delta& d) {
-    return in >> d.delta[0] >> d.delta[1]
-              >> d.delta[2] >> d.delta[3];
+Delta operator+(const Delta& d1, const Delta& d2) {
+    Delta res;
+    res.packed = Delta::add(d1.packed, d2.packed);
+    return res;
 }
 
-std::ostream& operator<<(std::ostream& out, const Delta& o) {
-    return out << "{" << o.delta[0] << "," << o.delta[1] << ","
-               << o.delta[2] << "," << o.delta[3] << "}";
+
+// Inventory.hpp
+
+
+#include <array>
+#include <cstdint>
+
+using inv_t = int16_t;
+
+// Numbers the C(14, 4) = 1001 inventories with four non-negative counts
+// summing to at most 10, so per-turn tables can be indexed by them.
+class Inventory {
+public:
+    static constexpr int COUNT = 1001;
+    static constexpr inv_t NONE = -1;
+
+    static inline inv_t index(const Delta& inv);
+    static inline const Delta& delta(const inv_t& index);
+    static inline eval_t eval(const inv_t& index);
+
+private:
+    static constexpr int BASE = Delta::MAX_INVENTORY + 1;
+    static constexpr int CODE_COUNT = BASE * BASE * BASE * BASE;
+
+    static inline int code(const Delta& inv);
+
+    struct Tables {
+        Tables();
+
+        std::array<Delta, COUNT> deltas;
+        std::array<eval_t, COUNT> evals;
+        std::array<inv_t, CODE_COUNT> indices;
+    };
+
+    static const Tables tables;
+};
+
+int Inventory::code(const Delta& inv) {
+    return ((inv[0] * BASE + inv[1]) * BASE + inv[2]) * BASE + inv[3];
 }
 
-Delta operator+(const Delta& d1, const Delta& d2) {
-    Delta res;
-    for (int i = 0; i < 4; ++i)
-        res[i] = d1[i] + d2[i];
-    return res;
+inv_t Inventory::index(const Delta& inv) {
+    return tables.indices[code(inv)];
+}
+
+const Delta& Inventory::delta(const inv_t& index) {
+    return tables.deltas[index];
+}
+
+eval_t Inventory::eval(const inv_t& index) {
+    return tables.evals[index];
 }
 
 
+// Action.hpp
+
+
 #include <array>
 
 struct Action {
@@ -167,7 +561,7 @@ struct Action {
     Action() = default;
     Action(const int& id, const Delta& delta);
 
-    virtual void print() const = 0;
+    virtual void print(std::ostream& out) const = 0;
     virtual ~Action() = default;
 };
 
@@ -176,7 +570,7 @@ struct Order : public Action {
 
     Order() = default;
     Order(const int& id, const Delta& delta, const int& price);
-    void print() const override;
+    void print(std::ostream& out) const override;
 
     friend std::ostream& operator<<(std::ostream& out, const Order& o);
 };
@@ -189,7 +583,7 @@ struct Recipe : public Action {
     Recipe() = default;
     Recipe(const int& id, const Delta& delta,
         const int &tomeIndex, const int& taxCount, const bool& repeatable);
-    void print() const override;
+    void print(std::ostream& out) const override;
 
     friend std::ostream& operator<<(std::ostream& out, const Recipe& r);
 };
@@ -207,14 +601,14 @@ struct Spell : public Action {
     Spell(const int& id, const Delta& delta,
         const bool& castable, const bool& repeatable);
     Spell(const Recipe& recipe);
-    void print() const override;
+    void print(std::ostream& out) const override;
 
     friend std::ostream& operator<<(std::ostream& out, const Spell& s);
 };
 
 struct Rest : public Action {
 	Rest() = default;
-    void print() const override;
+    void print(std::ostream& out) const override;
 };
 
 struct Witch {
@@ -234,175 +628,393 @@ eval_t Witch::eval() const {
 }
 
 
-#include <cassert>
+// DeltaBatch.hpp
 
-Action::Action(const int& id, const Delta& delta) :
-    delta(delta), id(id) {
 
-}
+#include <cstdint>
+#include <vector>
 
-Order::Order(const int& id, const Delta& delta, const int& price) :
-    Action(id, delta), price(price) {
+// Deltas laid out to be tested against one inventory all at once. Which
+// of them can be applied comes back as a bitmask, delta k in bit k % 64
+// of word k / 64. The test runs 16, 8 or 4 deltas a step with AVX-512,
+// AVX2 or SSE4.2, whichever the CPU has, picked once at startup, and
+// falls back to Delta::canApply() one by one without any of them.
+class DeltaBatch {
+public:
+    static constexpr int WIDTH = 16;
 
-}
+    void assign(const std::vector<Delta>& deltas);
+    int size() const;
+    int maskWords() const;
 
-void Order::print() const {
-    std::cout << "BREW " << id << std::endl;
-}
+    void applicable(const Delta& inv, uint64_t* masks) const {
+        variant().run(*this, inv, masks);
+    }
 
-std::ostream& operator<<(std::ostream& out, const Order& o) {
-    return out << "ORDER: id=" << o.id 
-        << ", delta=" << o.delta << ", "
-        << "price=" << o.price;
-}
+    static const char* kernel();
 
-Recipe::Recipe(const int& id, const Delta& delta,
-    const int& tomeIndex, const int& taxCount, const bool& repeatable) :
-    Action(id, delta), tomeIndex(tomeIndex), taxCount(taxCount), repeatable(repeatable) {
+private:
+    using Kernel = void (*)(const DeltaBatch&, const Delta&, uint64_t*);
 
-}
+    struct Variant {
+        const char* name;
+        Kernel run;
+    };
 
-void Recipe::print() const {
-    std::cout << "LEARN " << id << std::endl;
-}
+    static const Variant& variant();
+    static Variant pick();
 
-std::ostream& operator<<(std::ostream& out, const Recipe& r) {
-    return out << "RECIPE: id=" << r.id 
-        << ", delta={" << r.delta << ", "
-        << "tomeIndex=" << r.tomeIndex << ", "
-        << "taxCount=" << r.taxCount << ", "
-        << "repeatable=" << r.repeatable;
-}
+    static void applicableAvx512(const DeltaBatch& batch, const Delta& inv, uint64_t* masks);
+    static void applicableAvx2(const DeltaBatch& batch, const Delta& inv, uint64_t* masks);
+    static void applicableSse42(const DeltaBatch& batch, const Delta& inv, uint64_t* masks);
+    static void applicableScalar(const DeltaBatch& batch, const Delta& inv, uint64_t* masks);
 
-Spell::Spell(const int& id, const Delta& delta,
-    const bool& castable, const bool& repeatable) :
-    Action(id, delta), castable(castable), repeatable(repeatable) {
+    // padded to a multiple of WIDTH with deltas no inventory can take
+    std::vector<uint32_t> packed;
+    std::vector<int32_t> sums;
+    int count = 0;
+};
 
-    if (repeatable) {
-        int provide = 0, supply = 0;
-        for (int i = 0; i < 4; ++i)
-            if (delta[i] < 0)
-                provide -= delta[i];
-            else
-                supply += delta[i];
 
-        assert(provide >= 0 && supply >= 0);
+// Snapshot.hpp
 
-        maxTimes = 10;
-        if (provide > 0)
-            maxTimes = std::min(maxTimes, 10 / provide);
-        if (supply > 0)
-            maxTimes = std::min(maxTimes, 10 / supply);
-    }
 
-    assert(maxTimes <= MAX_REPEATED_DELTA);
+#include <vector>
 
-    repeatedDeltas[0] = delta;
-    for (int i = 1; i < maxTimes; ++i)
-        repeatedDeltas[i] = repeatedDeltas[i - 1] + delta;
-}
+// One turn of the game as the referee describes it, in the order it lists
+// the actions.
+struct Snapshot {
+    std::vector<Order> orders;
+    std::vector<Recipe> recipes;
+    std::vector<Spell> spells;
+    std::vector<Spell> opponentSpells;
+    Witch player;
+    Witch opponent;
 
-Spell::Spell(const Recipe& recipe) :
-    Spell(recipe.id, recipe.delta, true, recipe.repeatable) {
+    // Reads the next frame, keeping the vectors' capacity.
+    void read(Reader& in);
+};
 
-}
 
-void Spell::print() const {
-    assert(curTimes >= 1);
-    std::cout << "CAST " << id << " " << curTimes << std::endl;
-}
+// SearchEngine.hpp
 
-std::ostream& operator<<(std::ostream& out, const Spell& s) {
-    return out << "SPELL: id=" << s.id 
-        << ", delta=" << s.delta << ", "
-        << "castable=" << s.castable << ", "
-        << "maxTimes=" << s.maxTimes;
-}
 
-void Rest::print() const {
-    std::cout << "REST" << std::endl;
-}
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
 
-std::istream& operator>>(std::istream& in, Witch& w) {
-    return in >> w.inv >> w.score;
-}
+struct State;
+class Beam;
+class Mcts;
 
-std::ostream& operator<<(std::ostream& out, const Witch& w) {
-    return out << "delta=" << w.inv << ", " << "score=" << w.score;
-}
+using action_id_t = uint8_t;
 
+struct SearchStats {
+    int depth = 0;
+    int width = 0;
+    int seeded = 0;
+    long long expanded = 0;
+    long long generated = 0;
+    long long duplicates = 0;
+    bool aborted = false;
+    float time = 0;
+    float overshoot = 0;
+    std::vector<float> layerTimes;
+    std::vector<int> layerDuplicates;
+
+    void reset();
+};
 
-#include <array>
+struct MctsStats {
+    long long iterations = 0;
+    int nodes = 0;
+    int depth = 0;
+    int reused = 0;
+    float time = 0;
+    float overshoot = 0;
+    // SearchEngine::NO_ACTION
+    action_id_t firstAction = UINT8_MAX;
 
-struct State;
+    void reset();
+};
+
+// The action is one of the engine's and stays valid until its next turn.
+// Only the stats of the engine that searched are filled.
+struct Decision {
+    const Action* action = nullptr;
+    SearchStats search;
+    MctsStats mcts;
+};
+
+// Plays one side of one game: besides its buffers, an engine keeps what
+// it learns about the game from turn to turn, so it is given every turn
+// of that game in order, and newGame() before the next one. Engines share
+// nothing, so each can play on a thread of its own.
+class SearchEngine {
+    friend class Bench;
+    friend class Mcts;
 
-class Battle {
 public:
-    static void start();
+    SearchEngine();
+    SearchEngine(const SearchEngine&) = delete;
+    SearchEngine& operator=(const SearchEngine&) = delete;
+    ~SearchEngine();
+
+    // received is when the turn's input arrived, which the referee's
+    // clock counts from.
+    Decision decide(const Snapshot& snapshot,
+        const Timer::Clock::time_point& received = Timer::Clock::now());
+    // Logs how decision was reached. Called once its action is out, as
+    // DEBUG builds, the merged submission among them, would otherwise
+    // format all of it on the turn's clock.
+    void report(const Decision& decision) const;
+    void newGame();
+    // Derives the tables of params; beamWidth is taken from them too.
+    void setParams(const Options::Params& params);
 
 private:
-    static void resetData();
-    static void readData();
+    void load(const Snapshot& snapshot);
+    void buildTables();
     #ifdef DEBUG
-    static void writeData();
+    void writeData() const;
     #endif
-    static const Action* pickAction();
-    static const Action* chooseRecipe();
-    static const Action* search();
-    static State getInitialState();
+    const Action* pickAction(const Timer::Clock::time_point& received);
+    const Action* chooseRecipe();
+    const Action* search(float timeLimit, int maxDepth = INF);
+    const Action* search(const Timer& timer, int maxDepth = INF);
+    State getInitialState() const;
+    // What a search rooted at s starts its evaluation from.
+    eval_t rootEvaluation(const State& s) const;
+    std::string describe(const State& s) const;
+    void buildActionTable();
+    void buildTransitions();
+    void buildOrderDistances();
+    void buildRivalBrewTurns();
+    void reserveBuffers();
+    int takeSeeds(const State& root);
+    // Turns s, on a line through next, into the state a search rooted at
+    // next reaches, whose root evaluation is nextRootEvaluation: a move
+    // shallower, with what gamma weighed scaled back by one decay.
+    void reroot(State& s, const State& next, const eval_t& nextRootEvaluation) const;
+    void carryOver(const State& root, const Beam& layer, const int& count,
+        const action_id_t& action);
+    bool expand(const Beam& parents, const int& parentCount, Beam& children,
+        const Timer* timer);
+    int removeDuplicates(const Beam& states, const Timer* timer);
+    MULTIVERSION int selectBest(const Beam& states, const int& stateCount, Beam& selected,
+        const Timer* timer);
 
 public:
-    static int spellCount;
-    static int orderCount;
-    static int recipeCount;
-    static int customSpellCount;
+    int spellCount;
+    int orderCount;
+    int recipeCount;
 
     static constexpr int MAX_SPELL_COUNT = 20;
     static constexpr int MAX_ORDER_COUNT = 5;
     static constexpr int MAX_RECIPE_COUNT = 6;
 
-    static std::array<Spell, MAX_SPELL_COUNT> spells;
-    static std::array<Order, MAX_ORDER_COUNT> orders;
-    static std::array<Recipe, MAX_RECIPE_COUNT> recipes;
-    static std::array<Spell, MAX_SPELL_COUNT> customSpells;
-    static std::array<Spell, MAX_RECIPE_COUNT> spellsFromRecipes;
-    static Rest rest;
+    std::array<Spell, MAX_SPELL_COUNT> spells;
+    std::array<Order, MAX_ORDER_COUNT> orders;
+    std::array<Recipe, MAX_RECIPE_COUNT> recipes;
+    std::array<Spell, MAX_RECIPE_COUNT> spellsFromRecipes;
+    Rest rest;
+
+    // The opponent's spells never enter a state key, and it may learn the
+    // whole tome: its 42 recipes on top of the 4 starting spells.
+    static constexpr int MAX_OPPONENT_SPELL_COUNT = 46;
+
+    int opponentSpellCount;
+    std::array<Spell, MAX_OPPONENT_SPELL_COUNT> opponentSpells;
+
+    // Every action the root can take, addressed by the small id states keep
+    // as their first action: orders, then recipes, then rest, then each
+    // spell cast 1..maxTimes times, in the order of their cast slots.
+    static constexpr int MAX_CAST_COUNT = MAX_SPELL_COUNT * Spell::MAX_REPEATED_DELTA;
+    static constexpr int REST_ACTION = MAX_ORDER_COUNT + MAX_RECIPE_COUNT;
+    static constexpr int FIRST_CAST_ACTION = REST_ACTION + 1;
+    static constexpr int MAX_ACTION_COUNT = FIRST_CAST_ACTION + MAX_CAST_COUNT;
+    static constexpr action_id_t NO_ACTION = UINT8_MAX;
+    // a move with no id this turn, like casting a spell learnt on the way
+    static constexpr action_id_t UNKNOWN_ACTION = NO_ACTION - 1;
+    // the first action of every MCTS state, whose second is the move into it
+    static constexpr action_id_t TREE_ACTION = UNKNOWN_ACTION - 1;
+    static_assert(MAX_ACTION_COUNT <= TREE_ACTION, "action ids don't fit action_id_t");
+
+    std::array<const Action*, MAX_ACTION_COUNT> actions;
+    std::array<Spell, MAX_CAST_COUNT> casts;
+
+    // Inventory reached from every inventory by every cast and order this
+    // turn, or Inventory::NONE when it can't be afforded. A row holds the
+    // casts of spells (spell i cast j + 1 times is at spellCastSlots[i] + j),
+    // then those of spells from recipes, then the orders. slotDeltas holds
+    // the delta of every slot, and slotBatch the same for testing them all
+    // against an inventory at once.
+    std::vector<Delta> slotDeltas;
+    DeltaBatch slotBatch;
+    std::vector<inv_t> transitions;
+    int transitionStride;
+    int orderSlot;
+    std::array<int, MAX_SPELL_COUNT> spellCastSlots;
+    std::array<int, MAX_RECIPE_COUNT> recipeCastSlots;
+
+    int maxNeighbors;
+
+    inline const inv_t* transitionRow(const inv_t& inv) const;
+
+    // Fewest casts that take an inventory to one affording each order, with
+    // this turn's spells and ignoring the rests exhaustion would force, so
+    // a lower bound on the turns needed. UNREACHABLE if no cast sequence
+    // gets there.
+    static constexpr uint8_t UNREACHABLE = UINT8_MAX;
+    std::vector<uint8_t> orderDistances;
+
+    inline uint8_t orderDistance(const inv_t& inv, const int& order) const;
+
+    // Earliest turn, counting the brew itself, the opponent could brew each
+    // order using its current spells and ignoring rests. Orders we'd brew
+    // later than that are likely gone by then and get discounted by
+    // Options::Params::rivalDiscount.
+    std::array<uint8_t, MAX_ORDER_COUNT> rivalBrewTurns;
+
+    // Orders done so far, counted from changes of score between turns.
+    int playerOrdersDone;
+    int enemyOrdersDone;
+    int lastPlayerScore;
+    int lastEnemyScore;
 
-    static int playerOrdersDone;
-    static int enemyOrdersDone;
-
-    static Witch player;
-    static Witch opponent;
-
-    static int roundNumber;
-    static int recipeDoneCount;
-    static constexpr int BEAM_WIDTH = 2000;
+    Witch player;
+    Witch opponent;
+
+    // The game ends after MAX_ROUNDS rounds, so no line is searched past
+    // the rounds left; State::depth and the rival's brew turns count up
+    // to it.
+    static constexpr int MAX_ROUNDS = 100;
+    int roundNumber;
+    int recipeDoneCount;
+    int roundsLeft() const;
+
+    enum class Engine {
+        BEAM,
+        MCTS
+    };
+    Engine engine;
+
+    Options::Params params;
+    // params differ from Options::DEFAULTS where Compiled would fix them
+    bool tuned;
+
+    int beamWidth;
+    int threadCount;
+    static constexpr int MIN_PARENTS_PER_THREAD = 64;
+    static constexpr int TIME_CHECK_INTERVAL = 256;
+
+    float firstTurnTimeLimit;
+    float turnTimeLimit;
+    // Taken off the turn limit for printing the action and flushing the
+    // log, and four times that off the first turn's; never more than a
+    // quarter of either.
+    float deadlineMargin;
+
+    // Children of one layer, as [begin, begin + count) runs of the buffer
+    // they were generated into, one per worker.
+    struct Slice {
+        int begin;
+        int count;
+    };
+    std::vector<Slice> slices;
+    WorkerPool workers;
+
+    struct Candidate {
+        eval_t evaluation;
+        int index;
+
+        bool operator>(const Candidate& c) const {
+            return evaluation > c.evaluation;
+        }
+    };
+
+    // Search buffers, sized for beamWidth * maxNeighbors states before the
+    // clock starts so no layer has to allocate.
+    static constexpr int LAYER_COUNT = 2;
+    std::unique_ptr<Beam[]> layers;
+    TranspositionTable transpositions;
+    std::vector<int> survivors;
+    std::vector<Candidate> candidates;
+
+    // The last layer of the previous search, cut down to the states behind
+    // the move that was played and re-rooted one move later. It's merged
+    // into the layer of the same depth if this turn's root is the state
+    // that move was expected to reach, under the same spells, orders and
+    // recipes. Off in the bench unless asked for, as frames there needn't
+    // follow each other.
+    bool reuseSearch;
+    std::vector<State> carried;
+    std::vector<State> carriedNext;
+    uint64_t carriedSignature;
+    uint64_t carriedKey;
+
+    uint64_t tableSignature() const;
+
+    SearchStats stats;
+    std::unique_ptr<Mcts> mcts;
+    // the leaf the last beam search took its move from, for report()
+    std::unique_ptr<State> bestLeaf;
+
+    // scratch space of the per-turn tables
+    std::vector<uint64_t> applicable;
+    std::vector<int> predecessorBegin;
+    std::vector<int> predecessorEnd;
+    std::vector<int> predecessors;
+    std::vector<inv_t> orderQueue;
+    std::vector<uint8_t> rivalDistances;
+    std::vector<inv_t> rivalQueue;
 };
 
 struct State {
-    Witch player;
+    inv_t inv;
+    // the first two moves of the line that led here, from the root
+    action_id_t firstAction;
+    action_id_t secondAction;
+    int score;
     int castableSpellsMask;
     int ordersTodoMask;
     int recipesTodoMask;
     int castableSpellsFromRecipesMask;
     float gamma;
     eval_t evaluation;
+    // the part of evaluation weighted by gamma: orders and recipes
+    eval_t discounted;
     int ordersDone;
     int recipesLearnt;
+    uint16_t depth;
+
+    inline void recordAction(const action_id_t& action);
+    uint64_t key() const;
+    // Both use the compiled parameters unless the engine's were tuned.
+    eval_t leafEvaluation(const SearchEngine& engine) const;
+    int getNeighbors(const SearchEngine& engine, State* neighbors) const;
+
+    // P is Options::Compiled or Options::Runtime.
+    template<typename P> eval_t evaluateLeaf(const SearchEngine& engine) const;
+    template<typename P> int generateNeighbors(const SearchEngine& engine,
+        State* neighbors) const;
+    template<typename P> void getSpellActions(const SearchEngine& engine,
+        State* neighbors, int& neighborCount) const;
+    template<typename P> void castSpell(const SearchEngine& engine, const int& i,
+        State* neighbors, int& neighborCount) const;
+    template<typename P> void getOrderActions(const SearchEngine& engine,
+        State* neighbors, int& neighborCount) const;
+    template<typename P> void brewOrder(const SearchEngine& engine, const int& i,
+        const inv_t* next, State* neighbors, int& neighborCount) const;
+    template<typename P> void getRecipeActions(const SearchEngine& engine,
+        State* neighbors, int& neighborCount) const;
+    template<typename P> void useRecipe(const SearchEngine& engine, const int& i,
+        const bool& canLearn, State* neighbors, int& neighborCount) const;
+    template<typename P> void getRestAction(const SearchEngine& engine,
+        State* neighbors, int& neighborCount) const;
 
-    const Action* firstAction;
-
-    static constexpr int MAX_NEIGHBORS = 30;
-    static constexpr float DECAY = 0.97f;
-    static constexpr float LEARN_DECAY = 0.6f;
-
-    int getNeighbors(State* neighbors) const;
-    void getSpellActions(State* neighbors, int& neighborCount) const;
-    void getOrderActions(State* neighbors, int& neighborCount) const;
-    void getRecipeActions(State* neighbors, int& neighborCount) const;
-    void getRestAction(State* neighbors, int& neighborCount) const;
-
-    friend std::ostream& operator<<(std::ostream& out, const State& s);
     bool isCastable(const int& i) const;
     bool isOrderDoable(const int& i) const;
     bool isRecipeDoable(const int& i) const;
@@ -411,46 +1023,160 @@ struct State {
     bool operator>(const State& s) const;
 };
 
+const inv_t* SearchEngine::transitionRow(const inv_t& inv) const {
+    return transitions.data() + inv * transitionStride;
+}
 
-#include <cassert>
-#include <algorithm>
-#include <cstring>
-#include <cmath>
-
-bool State::operator<(const State& s) const {
-    return evaluation < s.evaluation;
+// Called on a copy of the parent, so the fields still hold its line.
+void State::recordAction(const action_id_t& action) {
+    if (firstAction == SearchEngine::NO_ACTION)
+        firstAction = action;
+    else if (secondAction == SearchEngine::NO_ACTION)
+        secondAction = action;
 }
 
-bool State::operator>(const State& s) const {
-    return evaluation > s.evaluation;
+uint8_t SearchEngine::orderDistance(const inv_t& inv, const int& order) const {
+    return orderDistances[inv * MAX_ORDER_COUNT + order];
 }
 
-std::ostream& operator<<(std::ostream& out, const State& s) {
-    out << s.player << "\n";
-    out << "gamma=" << s.gamma << "\n";
-    out << "evaluation=" << s.evaluation << "\n";
-    out << "ordersDone=" << s.ordersDone << "\n";
-    out << "recipesLearnt=" << s.recipesLearnt << "\n";
 
-    out << "SPELLS:\n";
-    for (int i = 0; i < Battle::spellCount; ++i) {
-        out << "\t" << (s.isCastable(i) ? "CASTABLE" : "NONCASTABLE") << " ";
-        out << Battle::spells[i] << "\n";
-    }
+// Mcts.hpp
 
-    out << "ORDERS:\n";
-    for (int i = 0; i < Battle::orderCount; ++i) {
-        out << "\t" << (s.isOrderDoable(i) ? "DOABLE" : "DONE") << " ";
-        out << Battle::orders[i] << "\n";
-    }
 
-    out << "RECIPES:\n";
-    for (int i = 0; i < Battle::recipeCount; ++i) {
-        out << "\t" << (s.isRecipeDoable(i) ? "DOABLE" : "DONE") << " ";
-        out << Battle::recipes[i] << "\n";
+#include <cstdint>
+#include <vector>
+
+// UCT over the same move generator as the beam search. Nodes live in an
+// arena allocated on the first search, children of a node next to each
+// other, and leaves are valued by leafEvaluation() at the end of a short
+// random playout. The secondAction of a node is the move leading into it,
+// under a firstAction of SearchEngine::TREE_ACTION.
+// When this turn's root is the child played last turn, under the same
+// tables, its subtree is kept, rebased onto the new root, and the search
+// carries on from there.
+class Mcts {
+    friend class Bench;
+
+public:
+    explicit Mcts(SearchEngine& engine);
+    Mcts(const Mcts&) = delete;
+    Mcts& operator=(const Mcts&) = delete;
+
+    const Action* search(float timeLimit, long long maxIterations = INF);
+    const Action* search(const Timer& timer, long long maxIterations = INF);
+    // Drops the tree kept for the next search.
+    void forget();
+
+    static constexpr int MAX_NODES = 1 << 19;
+    static constexpr int ROLLOUT_DEPTH = 8;
+    static constexpr int TIME_CHECK_INTERVAL = 16;
+
+    MctsStats stats;
+
+private:
+    struct Node {
+        int firstChild;
+        int childCount;
+        int visits;
+        eval_t value;
+        // the part of value gamma weighed, orders and recipes
+        eval_t discounted;
+    };
+
+    void reserveArena();
+    bool reuseTree(const State& initialState);
+    void reroot();
+    int selectChild(const int& parent);
+    bool expand(const int& node);
+    State rollout(const State& state);
+    void backpropagate(const State& leaf);
+    inline uint32_t random();
+
+    SearchEngine& engine;
+
+    // states[i] is the state of nodes[i]
+    std::vector<Node> nodes;
+    std::vector<State> states;
+    int nodeCount = 0;
+    int root = 0;
+    int played = -1;
+    uint64_t playedSignature = 0;
+
+    std::vector<State> playout;
+    std::vector<int> path;
+    eval_t minReward = 0;
+    eval_t maxReward = 0;
+    uint32_t seed = 2463534242u;
+};
+
+uint32_t Mcts::random() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+
+// Beam.hpp
+
+
+#include <cstdint>
+
+// A layer of states with the fields deduplication scans, the key and the
+// evaluation, also kept in arrays of their own, every array aligned to a
+// cache line. Only the survivors of a layer are read as whole states.
+class Beam {
+public:
+    static constexpr int ALIGNMENT = 64;
+
+    Beam() = default;
+    Beam(const Beam&) = delete;
+    Beam& operator=(const Beam&) = delete;
+    ~Beam();
+
+    // Keeps the contents only if capacity is already enough.
+    void reserve(const int& capacity);
+    int capacity() const;
+
+    // Fills the scanned fields of states [begin, begin + count) from them.
+    inline void index(const int& begin, const int& count);
+
+    State* states = nullptr;
+    uint64_t* keys = nullptr;
+    eval_t* evaluations = nullptr;
+
+private:
+    void* block = nullptr;
+    int size = 0;
+};
+
+void Beam::index(const int& begin, const int& count) {
+    for (int i = begin; i < begin + count; ++i) {
+        keys[i] = states[i].key();
+        evaluations[i] = states[i].evaluation;
     }
+}
+
+
+// SearchEngine.cpp
+
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cmath>
+#include <sstream>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable<State>::value,
+    "states are memcpy'd and expanded on several threads");
+
+bool State::operator<(const State& s) const {
+    return evaluation < s.evaluation;
+}
 
-    return out;
+bool State::operator>(const State& s) const {
+    return evaluation > s.evaluation;
 }
 
 bool State::isCastable(const int& i) const {
@@ -465,23 +1191,97 @@ bool State::isRecipeDoable(const int& i) const {
     return recipesTodoMask & 1 << i;
 }
 
-int State::getNeighbors(State* neighbors) const {
+// Packs everything that tells two states of the same layer apart into 47
+// bits: the inventory index, then the spell, order, recipe and
+// learnt-spell masks.
+uint64_t State::key() const {
+    static_assert(SearchEngine::MAX_SPELL_COUNT <= 20, "spell mask doesn't fit the key");
+    static_assert(SearchEngine::MAX_ORDER_COUNT <= 5, "order mask doesn't fit the key");
+    static_assert(SearchEngine::MAX_RECIPE_COUNT <= 6, "recipe mask doesn't fit the key");
+
+    static_assert(Inventory::COUNT <= 1 << 10, "inventory index doesn't fit the key");
+
+    return uint64_t(inv) |
+        uint64_t(castableSpellsMask) << 10 |
+        uint64_t(ordersTodoMask) << 30 |
+        uint64_t(recipesTodoMask) << 35 |
+        uint64_t(castableSpellsFromRecipesMask) << 41;
+}
+
+// The evaluation accumulated along the path plus part of the price of the
+// best open order the state could brew within a few more casts, decayed
+// as if it had been brewed after that many more moves.
+template<typename P>
+eval_t State::evaluateLeaf(const SearchEngine& engine) const {
+    const auto& p = P::get(engine.params);
+    eval_t nearOrder = 0;
+    int ordersTodoMask = this->ordersTodoMask;
+    while (ordersTodoMask) {
+        int nextOrderBit = low(ordersTodoMask);
+        int i = bits(nextOrderBit);
+        int distance = engine.orderDistance(inv, i);
+        if (distance <= Options::MAX_NEAR_ORDER_DISTANCE) {
+            eval_t value = engine.orders[i].price * p.nearOrderDecay[distance];
+            if (depth + distance + 1 > engine.rivalBrewTurns[i])
+                value *= p.rivalDiscount;
+            nearOrder = std::max(nearOrder, value);
+        }
+        ordersTodoMask ^= nextOrderBit;
+    }
+
+    return evaluation + 100 * gamma * nearOrder;
+}
+
+eval_t State::leafEvaluation(const SearchEngine& engine) const {
+    if (engine.tuned)
+        return evaluateLeaf<Options::Runtime>(engine);
+    return evaluateLeaf<Options::Compiled>(engine);
+}
+
+namespace {
+    // Multiversioned here rather than as State::getNeighbors: GCC 12 only
+    // emits the clones in the file defining them, so a caller in another
+    // one, under LTO, can't link to them. Flattened, so the generators are
+    // compiled for each clone's instruction set too.
+    MULTIVERSION __attribute__((flatten)) int neighborsOf(const State& state,
+        const SearchEngine& engine, State* neighbors) {
+        if (engine.tuned)
+            return state.generateNeighbors<Options::Runtime>(engine, neighbors);
+        return state.generateNeighbors<Options::Compiled>(engine, neighbors);
+    }
+}
+
+int State::getNeighbors(const SearchEngine& engine, State* neighbors) const {
+    STATS_TIME(EXPAND);
+    int neighborCount = neighborsOf(*this, engine, neighbors);
+    STATS_COUNT(NEIGHBOR_CALLS, 1);
+    STATS_COUNT(NEIGHBORS, neighborCount);
+    return neighborCount;
+}
+
+// Not specialized per spell, order or recipe count: copies with those
+// fixed and the loops over them unrolled were no faster than this one
+// built for the host's instruction set, and doubled the code.
+template<typename P>
+int State::generateNeighbors(const SearchEngine& engine, State* neighbors) const {
     int neighborCount = 0;
 
     if (ordersDone == 6) {
-        getRestAction(neighbors, neighborCount);
+        getRestAction<P>(engine, neighbors, neighborCount);
         return neighborCount;
     }
 
-    getSpellActions(neighbors, neighborCount);
-    getOrderActions(neighbors, neighborCount);
-    getRecipeActions(neighbors, neighborCount);
-    getRestAction(neighbors, neighborCount);
+    getSpellActions<P>(engine, neighbors, neighborCount);
+    getOrderActions<P>(engine, neighbors, neighborCount);
+    getRecipeActions<P>(engine, neighbors, neighborCount);
+    getRestAction<P>(engine, neighbors, neighborCount);
 
     return neighborCount;
 }
 
-void State::getSpellActions(State* neighbors, int& neighborCount) const {
+template<typename P>
+void State::getSpellActions(const SearchEngine& engine, State* neighbors,
+    int& neighborCount) const {
     int castableSpellsMask = this->castableSpellsMask;
     while (castableSpellsMask) {
         int nextSpellBit = low(castableSpellsMask);
@@ -489,35 +1289,40 @@ void State::getSpellActions(State* neighbors, int& neighborCount) const {
 
         int i = bits(nextSpellBit);
         assert(nextSpellBit == (1 << i));
-        assert(0 <= i && i < Battle::spellCount);
-
-        const auto& s = Battle::spells[i];
-        for (int j = 0; j < s.maxTimes; ++j) {
-            const auto& delta = s.repeatedDeltas[j];
-            if (!player.inv.canApply(delta))
-                break;
-
-            auto& neighbor = neighbors[neighborCount++];
-            std::memcpy(&neighbor, this, sizeof(State));
-            neighbor.player.inv += delta;
-            neighbor.castableSpellsMask ^= nextSpellBit;
-            neighbor.gamma *= DECAY;
-            neighbor.evaluation += delta.eval() - 0.01f;
-
-            if (firstAction == nullptr) {
-                auto& customSpell = Battle::customSpells[Battle::customSpellCount++];
-                customSpell = s;
-                customSpell.curTimes = j + 1;
-                neighbor.firstAction = &customSpell;
-            }
-        }
+        castSpell<P>(engine, i, neighbors, neighborCount);
 
         assert((castableSpellsMask & nextSpellBit) == nextSpellBit);
         castableSpellsMask ^= nextSpellBit;
     }
 }
 
-void State::getOrderActions(State* neighbors, int& neighborCount) const {
+template<typename P>
+void State::castSpell(const SearchEngine& engine, const int& i, State* neighbors,
+    int& neighborCount) const {
+    assert(0 <= i && i < engine.spellCount);
+    const auto& p = P::get(engine.params);
+    const auto& s = engine.spells[i];
+    const inv_t* next = engine.transitionRow(inv) + engine.spellCastSlots[i];
+    for (int j = 0; j < s.maxTimes; ++j) {
+        if (next[j] == Inventory::NONE)
+            break;
+
+        auto& neighbor = neighbors[neighborCount++];
+        std::memcpy(&neighbor, this, sizeof(State));
+        neighbor.inv = next[j];
+        neighbor.castableSpellsMask ^= 1 << i;
+        neighbor.gamma *= p.decay;
+        ++neighbor.depth;
+        neighbor.evaluation += Inventory::eval(next[j]) - Inventory::eval(inv) - p.castableValue;
+
+        neighbor.recordAction(SearchEngine::FIRST_CAST_ACTION + engine.spellCastSlots[i] + j);
+    }
+}
+
+template<typename P>
+void State::getOrderActions(const SearchEngine& engine, State* neighbors,
+    int& neighborCount) const {
+    const inv_t* next = engine.transitionRow(inv) + engine.orderSlot;
     int ordersTodoMask = this->ordersTodoMask;
     while (ordersTodoMask) {
         int nextOrderBit = low(ordersTodoMask);
@@ -525,177 +1330,255 @@ void State::getOrderActions(State* neighbors, int& neighborCount) const {
 
         int i = bits(nextOrderBit);
         assert(nextOrderBit == (1 << i));
-        assert(0 <= i && i < Battle::orderCount);
-
-        const auto& order = Battle::orders[i];
-        if (player.inv.canApply(order.delta)) {
-            auto& neighbor = neighbors[neighborCount++];
-            std::memcpy(&neighbor, this, sizeof(State));
-            neighbor.player.inv += order.delta;
-            neighbor.player.score += order.price;
-            neighbor.ordersTodoMask ^= nextOrderBit;
-            neighbor.gamma *= DECAY;
-            neighbor.evaluation += 100 * gamma * order.price;
-            if (++neighbor.ordersDone == 6)
-                neighbor.evaluation += 1e4;
-
-            if (firstAction == nullptr)
-                neighbor.firstAction = &order;
-        }
+        brewOrder<P>(engine, i, next, neighbors, neighborCount);
 
         assert((ordersTodoMask & nextOrderBit) == nextOrderBit);
         ordersTodoMask ^= nextOrderBit;
     }
 }
 
-void State::getRecipeActions(State* neighbors, int& neighborCount) const {
-    for (int i = 0; i < Battle::recipeCount; ++i)
-        if (recipesTodoMask & 1 << i) {
-            const auto& recipe = Battle::recipes[i];
+template<typename P>
+void State::brewOrder(const SearchEngine& engine, const int& i, const inv_t* next,
+    State* neighbors, int& neighborCount) const {
+    assert(0 <= i && i < engine.orderCount);
+    if (next[i] == Inventory::NONE)
+        return;
 
-            if (player.inv[0] >= recipe.tomeIndex) {
-                auto& neighbor = neighbors[neighborCount++];
-                std::memcpy(&neighbor, this, sizeof(State));
-                neighbor.recipesTodoMask ^= 1 << i;
-                neighbor.gamma *= DECAY;
-                neighbor.evaluation += gamma * std::pow(LEARN_DECAY, recipesLearnt) *
-                    (1 - recipe.tomeIndex / 3.f + recipe.taxCount / 6.f);
-                neighbor.recipesLearnt++;
+    const auto& p = P::get(engine.params);
+    const auto& order = engine.orders[i];
+    auto& neighbor = neighbors[neighborCount++];
+    std::memcpy(&neighbor, this, sizeof(State));
+    neighbor.inv = next[i];
+    neighbor.score += order.price;
+    neighbor.ordersTodoMask ^= 1 << i;
+    neighbor.gamma *= p.decay;
+    ++neighbor.depth;
+    eval_t value = 100 * gamma * order.price *
+        (neighbor.depth > engine.rivalBrewTurns[i] ? p.rivalDiscount : 1.f);
+    neighbor.evaluation += value;
+    neighbor.discounted += value;
+    if (++neighbor.ordersDone == 6)
+        neighbor.evaluation += p.lastOrderBonus;
+
+    neighbor.recordAction(i);
+}
 
-                if (firstAction == 0)
-                    neighbor.firstAction = &recipe;
-            }
-        }
-        else if (castableSpellsFromRecipesMask & 1 << i) {
-            const auto& s = Battle::spellsFromRecipes[i];
-            for (int j = 0; j < s.maxTimes; ++j) {
-                const auto& delta = s.repeatedDeltas[j];
-                if (!player.inv.canApply(delta))
-                    break;
+template<typename P>
+void State::getRecipeActions(const SearchEngine& engine, State* neighbors,
+    int& neighborCount) const {
+    // our spells, learnt ones included, have to fit the key's mask; those
+    // already learnt on this line stay castable
+    int learnt = engine.recipeCount - __builtin_popcount(recipesTodoMask);
+    bool canLearn = engine.spellCount + learnt < SearchEngine::MAX_SPELL_COUNT;
+    for (int i = 0; i < engine.recipeCount; ++i)
+        useRecipe<P>(engine, i, canLearn, neighbors, neighborCount);
+}
 
-                auto& neighbor = neighbors[neighborCount++];
-                std::memcpy(&neighbor, this, sizeof(State));
-                neighbor.player.inv += delta;
-                neighbor.castableSpellsFromRecipesMask ^= 1 << i;
-                neighbor.gamma *= DECAY;
-                neighbor.evaluation += delta.eval() - 0.01f;
+template<typename P>
+void State::useRecipe(const SearchEngine& engine, const int& i, const bool& canLearn,
+    State* neighbors, int& neighborCount) const {
+    const auto& p = P::get(engine.params);
+    if (recipesTodoMask & 1 << i) {
+        const auto& recipe = engine.recipes[i];
 
-                assert(firstAction != nullptr);
-            }
+        if (canLearn && Inventory::delta(inv)[0] >= recipe.tomeIndex) {
+            auto& neighbor = neighbors[neighborCount++];
+            std::memcpy(&neighbor, this, sizeof(State));
+            neighbor.recipesTodoMask ^= 1 << i;
+            neighbor.gamma *= p.decay;
+            ++neighbor.depth;
+            eval_t value = gamma * std::pow(p.learnDecay, recipesLearnt) *
+                (1 - recipe.tomeIndex / 3.f + recipe.taxCount / 6.f);
+            neighbor.evaluation += value;
+            neighbor.discounted += value;
+            neighbor.recipesLearnt++;
+
+            neighbor.recordAction(SearchEngine::MAX_ORDER_COUNT + i);
+        }
+    }
+    else if (castableSpellsFromRecipesMask & 1 << i) {
+        const auto& s = engine.spellsFromRecipes[i];
+        const inv_t* next = engine.transitionRow(inv) + engine.recipeCastSlots[i];
+        for (int j = 0; j < s.maxTimes; ++j) {
+            if (next[j] == Inventory::NONE)
+                break;
+
+            auto& neighbor = neighbors[neighborCount++];
+            std::memcpy(&neighbor, this, sizeof(State));
+            neighbor.inv = next[j];
+            neighbor.castableSpellsFromRecipesMask ^= 1 << i;
+            neighbor.gamma *= p.decay;
+            ++neighbor.depth;
+            neighbor.evaluation += Inventory::eval(next[j]) - Inventory::eval(inv) - p.castableValue;
+
+            assert(firstAction != SearchEngine::NO_ACTION);
+            neighbor.recordAction(SearchEngine::UNKNOWN_ACTION);
         }
+    }
 }
 
-void State::getRestAction(State* neighbors, int& neighborCount) const {
+template<typename P>
+void State::getRestAction(const SearchEngine& engine, State* neighbors,
+    int& neighborCount) const {
+    const auto& p = P::get(engine.params);
     auto& neighbor = neighbors[neighborCount++];
     std::memcpy(&neighbor, this, sizeof(State));
-    int turnOnCount = Battle::spellCount - __builtin_popcount(neighbor.castableSpellsMask) +
-        Battle::recipeCount - __builtin_popcount(neighbor.castableSpellsFromRecipesMask);
-    neighbor.castableSpellsMask = (1 << Battle::spellCount) - 1;
-    neighbor.castableSpellsFromRecipesMask = (1 << Battle::recipeCount) - 1;
-    neighbor.gamma *= DECAY;
-    neighbor.evaluation += turnOnCount * 0.01f;
-
-    if (firstAction == nullptr)
-        neighbor.firstAction = &Battle::rest;
+    int turnOnCount = engine.spellCount - __builtin_popcount(neighbor.castableSpellsMask) +
+        engine.recipeCount - __builtin_popcount(neighbor.castableSpellsFromRecipesMask);
+    neighbor.castableSpellsMask = (1 << engine.spellCount) - 1;
+    neighbor.castableSpellsFromRecipesMask = (1 << engine.recipeCount) - 1;
+    neighbor.gamma *= p.decay;
+    ++neighbor.depth;
+    neighbor.evaluation += turnOnCount * p.castableValue;
+
+    neighbor.recordAction(SearchEngine::REST_ACTION);
 }
 
-int Battle::spellCount;
-int Battle::orderCount;
-int Battle::recipeCount;
-int Battle::customSpellCount = 0;
+void SearchStats::reset() {
+    depth = width = seeded = 0;
+    expanded = generated = duplicates = 0;
+    aborted = false;
+    time = overshoot = 0;
+    layerTimes.clear();
+    layerDuplicates.clear();
+}
 
-std::array<Spell, Battle::MAX_SPELL_COUNT> Battle::spells;
-std::array<Order, Battle::MAX_ORDER_COUNT> Battle::orders;
-std::array<Recipe, Battle::MAX_RECIPE_COUNT> Battle::recipes;
-std::array<Spell, Battle::MAX_SPELL_COUNT> Battle::customSpells;
-std::array<Spell, Battle::MAX_RECIPE_COUNT> Battle::spellsFromRecipes;
-Rest Battle::rest;
+SearchEngine::SearchEngine() :
+    spellCount(0), orderCount(0), recipeCount(0), opponentSpellCount(0),
+    transitionStride(0), orderSlot(0), maxNeighbors(0),
+    engine(Engine::BEAM), params(Options::DEFAULTS), tuned(false),
+    beamWidth(Options::DEFAULTS.beamWidth), threadCount(1),
+    firstTurnTimeLimit(1000), turnTimeLimit(50), deadlineMargin(5),
+    layers(new Beam[LAYER_COUNT]), reuseSearch(true), mcts(new Mcts(*this)),
+    bestLeaf(new State()) {
 
-int Battle::playerOrdersDone = 0;
-int Battle::enemyOrdersDone = 0;
+    newGame();
+}
 
-Witch Battle::player;
-Witch Battle::opponent;
+SearchEngine::~SearchEngine() = default;
 
-int Battle::roundNumber = 0;
-int Battle::recipeDoneCount = 0;
+// Forgets everything learnt about the previous game.
+void SearchEngine::newGame() {
+    playerOrdersDone = enemyOrdersDone = 0;
+    lastPlayerScore = lastEnemyScore = 0;
+    roundNumber = recipeDoneCount = 0;
+    carried.clear();
+    carriedSignature = carriedKey = 0;
+    mcts->forget();
+}
 
-void Battle::start() {
-    while (true) {
-        resetData();
-        readData();
-        // #ifdef DEBUG
-        // writeData();
-        // #endif
+void SearchEngine::setParams(const Options::Params& params) {
+    this->params = params;
+    this->params.derive();
+    tuned = !Options::isDefault(this->params);
+    beamWidth = std::max(1, params.beamWidth);
+}
 
-        const Action* action = pickAction();
-        if (dynamic_cast<const Recipe*>(action)) {
-            debug("MAKING RECIPE");
-            ++recipeDoneCount;
-            debug(recipeDoneCount);
-        }
-        action->print();
+Decision SearchEngine::decide(const Snapshot& snapshot,
+    const Timer::Clock::time_point& received) {
+    load(snapshot);
+    // #ifdef DEBUG
+    // writeData();
+    // #endif
+
+    Decision decision;
+    decision.action = pickAction(received);
+    if (engine == Engine::MCTS)
+        decision.mcts = mcts->stats;
+    else
+        decision.search = stats;
+
+    if (dynamic_cast<const Recipe*>(decision.action))
+        ++recipeDoneCount;
+
+#ifdef STATS
+    if (engine == Engine::MCTS)
+        Stats::report(roundNumber, decision.mcts.iterations, decision.mcts.depth);
+    else
+        Stats::report(roundNumber, decision.search.expanded, decision.search.depth);
+#endif
 
-        ++roundNumber;
-    }
+    ++roundNumber;
+    return decision;
 }
 
-void Battle::resetData() {
-    spellCount = orderCount = recipeCount = customSpellCount = 0;
-}
+// Copies the turn into the fixed size tables the search indexes and
+// builds everything else it needs for the turn on top of them.
+void SearchEngine::load(const Snapshot& snapshot) {
+    assert(snapshot.spells.size() <= MAX_SPELL_COUNT);
+    assert(snapshot.orders.size() <= MAX_ORDER_COUNT);
+    assert(snapshot.recipes.size() <= MAX_RECIPE_COUNT);
+    assert(snapshot.opponentSpells.size() <= MAX_OPPONENT_SPELL_COUNT);
+
+    spellCount = int(snapshot.spells.size());
+    std::copy(snapshot.spells.begin(), snapshot.spells.end(), spells.begin());
+    orderCount = int(snapshot.orders.size());
+    std::copy(snapshot.orders.begin(), snapshot.orders.end(), orders.begin());
+    recipeCount = int(snapshot.recipes.size());
+    for (int i = 0; i < recipeCount; ++i) {
+        recipes[i] = snapshot.recipes[i];
+        spellsFromRecipes[i] = recipes[i];
+    }
+    opponentSpellCount = int(snapshot.opponentSpells.size());
+    std::copy(snapshot.opponentSpells.begin(), snapshot.opponentSpells.end(),
+        opponentSpells.begin());
 
-void Battle::readData() {
-    int actionCount;
-    std::cin >> actionCount;
+    player = snapshot.player;
+    opponent = snapshot.opponent;
 
-    while (actionCount--) {
-        int actionId;
-        std::string actionStr;
-        std::cin >> actionId >> actionStr;
-
-        Delta delta;
-        std::cin >> delta;
-
-        int price, tomeIndex, taxCount;
-        bool castable, repeatable;
-        std::cin >> price >> tomeIndex >> taxCount;
-        std::cin >> castable >> repeatable;
-
-        if (actionStr == "BREW")
-            orders[orderCount++] = Order(actionId, delta, price);
-        else if (actionStr == "CAST")
-            spells[spellCount++] = Spell(actionId, delta, castable, repeatable);
-        else if (actionStr == "LEARN") {
-            recipes[recipeCount] = Recipe(actionId, delta, tomeIndex, taxCount, repeatable);
-            spellsFromRecipes[recipeCount] = recipes[recipeCount];
-            ++recipeCount;
-        }
-        else
-            assert(actionStr == "OPPONENT_CAST");
-    }     
-
-    std::cin >> player;
-    std::cin >> opponent;
-
-    static float lastPlayerScore = 0;
     if (player.score != lastPlayerScore) {
         lastPlayerScore = player.score;
         ++playerOrdersDone;
     }
 
-    static float lastEnemyScore = 0;
     if (opponent.score != lastEnemyScore) {
         lastEnemyScore = opponent.score;
         ++enemyOrdersDone;
     }
 
-    assert(spellCount <= MAX_SPELL_COUNT);
-    assert(orderCount <= MAX_ORDER_COUNT);
-    assert(recipeCount <= MAX_RECIPE_COUNT);
+    buildTables();
+}
+
+// The opponent's distances don't depend on our tables, so with a second
+// worker they are computed alongside them.
+void SearchEngine::buildTables() {
+    workers.resize(threadCount);
+    auto build = [this](int worker) {
+        if (worker == 0) {
+            buildActionTable();
+            buildTransitions();
+            buildOrderDistances();
+        }
+        if (worker == 1 || workers.size() == 1)
+            buildRivalBrewTurns();
+    };
+
+    if (workers.size() == 1)
+        build(0);
+    else
+        workers.run(build);
+}
+
+void SearchEngine::report(const Decision& decision) const {
+    if (engine == Engine::MCTS) {
+        debug("MCTS iterations:", decision.mcts.iterations, decision.mcts.nodes,
+            decision.mcts.reused);
+        debug(decision.mcts.time, decision.mcts.overshoot);
+    }
+    else {
+        debug(describe(*bestLeaf));
+        debug("Beam search depth:", decision.search.depth, decision.search.seeded);
+        debug(decision.search.time, decision.search.overshoot, decision.search.aborted);
+    }
+
+    if (dynamic_cast<const Recipe*>(decision.action)) {
+        debug("MAKING RECIPE");
+        debug(recipeDoneCount);
+    }
 }
 
 #ifdef DEBUG
-void Battle::writeData() {
+void SearchEngine::writeData() const {
     for (const auto& order : orders)
         debug(order);
     for (const auto& spell : spells)
@@ -707,63 +1590,479 @@ void Battle::writeData() {
 }
 #endif
 
-const Action* Battle::pickAction() {
+const Action* SearchEngine::pickAction(const Timer::Clock::time_point& received) {
     // if (roundNumber < 6)
         // return chooseRecipe();
-    return search();
+    float timeLimit = roundNumber == 0 ? firstTurnTimeLimit : turnTimeLimit;
+    // the first turn also pays for starting the process, before received
+    float margin = roundNumber == 0 ? 4 * deadlineMargin : deadlineMargin;
+    // short limits, as given to the tuner or with -t, keep most of theirs
+    margin = std::min(margin, timeLimit / 4);
+    Timer timer(timeLimit - margin, received);
+    if (engine == Engine::MCTS)
+        return mcts->search(timer);
+    return search(timer);
+}
+
+int SearchEngine::roundsLeft() const {
+    static_assert(MAX_ROUNDS < UNREACHABLE, "depths must compare below UNREACHABLE");
+    static_assert(MAX_ROUNDS <= UINT16_MAX, "depths must fit State::depth");
+    return std::max(1, MAX_ROUNDS - roundNumber);
 }
 
-const Action* Battle::chooseRecipe() {
+const Action* SearchEngine::chooseRecipe() {
     return &recipes.front();
 }
 
-const Action* Battle::search() {
-    static constexpr int MAX_STATES = BEAM_WIDTH * State::MAX_NEIGHBORS;
-    static std::array<State, MAX_STATES> current, next;
-    int currentCount = 1, nextCount = 0;
-    current[0] = getInitialState();
+const Action* SearchEngine::search(float timeLimit, int maxDepth) {
+    return search(Timer(timeLimit), maxDepth);
+}
 
-    std::array<State, State::MAX_NEIGHBORS> neighbors;
+const Action* SearchEngine::search(const Timer& timer, int maxDepth) {
+    maxDepth = std::min(maxDepth, roundsLeft());
+    workers.resize(threadCount);
+    reserveBuffers();
+    Beam* current = &layers[0];
+    Beam* next = &layers[1];
+    int currentCount = 1, nextCount = 0;
+    State root = getInitialState();
+    current->states[0] = root;
 
-    float timeLimit = roundNumber == 0 ? 1000 : 50;
+    stats.reset();
     int depth = 0;
+    int seedDepth = takeSeeds(root);
 
-    for (Timer timer(timeLimit); timer.isTimeLeft(); ++depth) {       
+    // Any layer but the root's may be abandoned half-way once time is up;
+    // the answer then comes from the last layer that was fully selected.
+    // The root's is searched even past the deadline, for a move to play.
+    for (; depth < maxDepth && (depth == 0 || timer.isTimeLeft()); ++depth) {
         assert(currentCount > 0);
+        float layerStart = timer.elapsed();
+        const Timer* deadline = depth > 0 ? &timer : nullptr;
+
+        bool completed = expand(*current, currentCount, *next, deadline);
+        for (const auto& slice : slices)
+            nextCount += slice.count;
+        stats.expanded += currentCount;
+        stats.generated += nextCount;
+
+        if (!completed) {
+            stats.aborted = true;
+            break;
+        }
 
-        int considerCount = std::min(BEAM_WIDTH, currentCount);
-        for (int i = 0; i < considerCount; ++i) {
-            const auto& state = current[i];
-            nextCount += state.getNeighbors(next.data() + nextCount);
+        if (depth + 1 == seedDepth) {
+            int seedBegin = beamWidth * maxNeighbors;
+            std::copy(carried.begin(), carried.end(), next->states + seedBegin);
+            next->index(seedBegin, int(carried.size()));
+            slices.push_back({ seedBegin, int(carried.size()) });
+            nextCount += int(carried.size());
+            stats.seeded = int(carried.size());
         }
 
+        int uniqueCount = removeDuplicates(*next, deadline);
+        if (uniqueCount == -1) {
+            stats.aborted = true;
+            break;
+        }
+        stats.duplicates += nextCount - uniqueCount;
+        stats.layerDuplicates.push_back(nextCount - uniqueCount);
+        nextCount = uniqueCount;
+
         assert(nextCount > 0);
-        considerCount = std::min(BEAM_WIDTH, nextCount);
-        std::partial_sort(next.data(),
-            next.data() + considerCount,
-            next.data() + nextCount,
-            std::greater<State>());
-
-        std::swap(current, next);
-        currentCount = nextCount;
+        int selectedCount = selectBest(*next, nextCount, *current, deadline);
+        if (selectedCount == -1) {
+            stats.aborted = true;
+            break;
+        }
+        currentCount = selectedCount;
         nextCount = 0;
+
+        stats.layerTimes.push_back(timer.elapsed() - layerStart);
     }
 
+    // The previous search got deeper than this one did in time.
+    if (depth < seedDepth) {
+        std::copy(carried.begin(), carried.end(), current->states);
+        currentCount = int(carried.size());
+        stats.seeded = currentCount;
+        depth = seedDepth;
+    }
+
+    stats.depth = depth;
+    stats.width = currentCount;
+    stats.time = timer.elapsed();
+    stats.overshoot = stats.time - timer.limit();
     assert(currentCount > 0);
-    const auto& finalState = current[0];
-    debug(finalState);
-    assert(finalState.firstAction != nullptr);
-    debug("Beam search depth:", depth);
+    const auto& finalState = *std::max_element(current->states, current->states + currentCount,
+        [this](const State& a, const State& b) {
+            return a.leafEvaluation(*this) < b.leafEvaluation(*this);
+        });
+    *bestLeaf = finalState;
+
+    // only with maxDepth 0 is there no first move; resting is always legal
+    action_id_t action = finalState.firstAction;
+    if (action >= UNKNOWN_ACTION)
+        action = REST_ACTION;
+    carryOver(root, *current, currentCount, action);
+    return actions[action];
+}
+
+// Returns the depth the carried states are at from root, or -1 if they
+// don't apply to it.
+int SearchEngine::takeSeeds(const State& root) {
+    if (!reuseSearch || carried.empty() ||
+        carriedSignature != tableSignature() || carriedKey != root.key()) {
+        carried.clear();
+        return -1;
+    }
+    if (int(carried.size()) > beamWidth)
+        carried.resize(beamWidth);
+    return carried.front().depth;
+}
+
+// Keeps the states of layer whose line starts with action, as seen from
+// the state that action leads to: second moves become first ones and the
+// part of the evaluation weighted by gamma after the first move is scaled
+// back by one decay.
+void SearchEngine::carryOver(const State& root, const Beam& layer, const int& count,
+    const action_id_t& action) {
+
+    carriedNext.clear();
+    if (!reuseSearch)
+        return;
+
+    State* children = layers[1].states;
+    int childCount = root.getNeighbors(*this, children);
+    const State* child = std::find_if(children, children + childCount,
+        [action](const State& s) { return s.firstAction == action; });
+    assert(child != children + childCount);
+
+    eval_t childRootEvaluation = rootEvaluation(*child);
+    for (int i = 0; i < count; ++i) {
+        const State& s = layer.states[i];
+        if (s.firstAction != action || s.secondAction >= UNKNOWN_ACTION)
+            continue;
+
+        State seed = s;
+        seed.firstAction = s.secondAction;
+        seed.secondAction = UNKNOWN_ACTION;
+        reroot(seed, *child, childRootEvaluation);
+        carriedNext.push_back(seed);
+    }
+
+    std::swap(carried, carriedNext);
+    carriedSignature = tableSignature();
+    carriedKey = child->key();
+}
+
+void SearchEngine::reroot(State& s, const State& next, const eval_t& nextRootEvaluation) const {
+    // inventory and spell terms don't depend on depth, only the order and
+    // recipe values do
+    eval_t discounted = (s.discounted - next.discounted) / params.decay;
+    s.evaluation = nextRootEvaluation + (s.evaluation - s.discounted) -
+        (next.evaluation - next.discounted) + discounted;
+    s.discounted = discounted;
+    s.gamma /= params.decay;
+    --s.depth;
+}
+
+// Identifies this turn's spells, orders and recipes, the things state
+// masks and action ids are relative to.
+uint64_t SearchEngine::tableSignature() const {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&hash](const int& value) {
+        hash = (hash ^ uint32_t(value)) * 0x100000001b3ull;
+    };
+
+    mix(spellCount);
+    for (int i = 0; i < spellCount; ++i)
+        mix(spells[i].id);
+    mix(orderCount);
+    for (int i = 0; i < orderCount; ++i) {
+        mix(orders[i].id);
+        mix(orders[i].price);
+    }
+    mix(recipeCount);
+    for (int i = 0; i < recipeCount; ++i)
+        mix(recipes[i].id);
+    return hash;
+}
+
+// Leaves room for a layer of carried states after the children.
+void SearchEngine::reserveBuffers() {
+    size_t maxStates = size_t(beamWidth) * (maxNeighbors + 1);
+    for (int i = 0; i < LAYER_COUNT; ++i)
+        layers[i].reserve(int(maxStates));
+    if (candidates.size() < maxStates) {
+        survivors.resize(maxStates);
+        candidates.resize(maxStates);
+    }
+    transpositions.reserve(int(maxStates));
+}
+
+// Generates the children of all parents into slices of children. With a
+// timer, the clock is sampled every TIME_CHECK_INTERVAL parents and false
+// is returned, leaving the layer incomplete, once it has run out. Every
+// worker takes a contiguous run of parents and writes into the part of
+// the buffer reserved for them, so no synchronisation is needed until the
+// slices are merged in removeDuplicates(). Narrow layers, the root among
+// them, aren't worth waking the workers for. The scanned fields of the
+// children are filled right away, while they are still in L1.
+bool SearchEngine::expand(const Beam& parents, const int& parentCount, Beam& children,
+    const Timer* timer) {
+
+    auto expandOne = [this, &parents, &children](const int& i, const int& at) {
+        int neighborCount = parents.states[i].getNeighbors(*this, children.states + at);
+        children.index(at, neighborCount);
+        return neighborCount;
+    };
+
+    int workerCount = std::min(workers.size(), parentCount / MIN_PARENTS_PER_THREAD);
+    if (workerCount <= 1) {
+        int childCount = 0;
+        for (int i = 0; i < parentCount; ++i) {
+            if (timer && i % TIME_CHECK_INTERVAL == 0 && i > 0 && !timer->isTimeLeft()) {
+                slices.assign(1, { 0, childCount });
+                return false;
+            }
+            childCount += expandOne(i, childCount);
+        }
+        slices.assign(1, { 0, childCount });
+        return true;
+    }
+
+    std::atomic<bool> timeUp(false);
+    slices.assign(workerCount, { 0, 0 });
+    workers.run([&](int worker) {
+        if (worker >= workerCount)
+            return;
+
+        int begin = int(int64_t(parentCount) * worker / workerCount);
+        int end = int(int64_t(parentCount) * (worker + 1) / workerCount);
+        int childBegin = begin * maxNeighbors;
+        int childCount = 0;
+        for (int i = begin; i < end; ++i) {
+            if (timer && (i - begin) % TIME_CHECK_INTERVAL == 0 && i > begin) {
+                if (timeUp.load(std::memory_order_relaxed))
+                    break;
+                if (!timer->isTimeLeft()) {
+                    timeUp.store(true, std::memory_order_relaxed);
+                    break;
+                }
+            }
+            childCount += expandOne(i, childBegin + childCount);
+        }
+        slices[worker] = { childBegin, childCount };
+    });
+
+    return !timeUp.load();
+}
+
+// Keeps only the best evaluated copy of every state key, merging the
+// slices into the indices of the survivors. Only keys and evaluations are
+// read; no state is moved. Returns how many are left, or
+// -1 if the timer ran out first.
+int SearchEngine::removeDuplicates(const Beam& states, const Timer* timer) {
+    transpositions.clear();
+
+    int uniqueCount = 0, seen = 0;
+    for (const auto& slice : slices)
+        for (int i = slice.begin; i < slice.begin + slice.count; ++i) {
+            if (timer && ++seen % TIME_CHECK_INTERVAL == 0 && !timer->isTimeLeft())
+                return -1;
+            int j = transpositions.findOrInsert(states.keys[i], uniqueCount);
+            if (j == -1)
+                survivors[uniqueCount++] = i;
+            else if (states.evaluations[survivors[j]] < states.evaluations[i])
+                survivors[j] = i;
+        }
+
+    return uniqueCount;
+}
+
+// Copies the beamWidth best evaluated survivors into selected, in no
+// particular order. Only (evaluation, index) pairs are moved around while
+// selecting; every survivor is copied exactly once. Returns -1, leaving
+// selected untouched, if the timer runs out while scoring the states.
+int SearchEngine::selectBest(const Beam& states, const int& stateCount, Beam& selected,
+    const Timer* timer) {
+
+    STATS_TIME(SELECT);
+    STATS_COUNT(SELECTIONS, 1);
+    for (int i = 0; i < stateCount; ++i) {
+        if (timer && i % TIME_CHECK_INTERVAL == 0 && i > 0 && !timer->isTimeLeft())
+            return -1;
+        candidates[i] = { states.states[survivors[i]].leafEvaluation(*this), survivors[i] };
+    }
+
+    int selectedCount = std::min(beamWidth, stateCount);
+    if (selectedCount < stateCount)
+        std::nth_element(candidates.begin(),
+            candidates.begin() + selectedCount,
+            candidates.begin() + stateCount,
+            std::greater<Candidate>());
+
+    for (int i = 0; i < selectedCount; ++i)
+        selected.states[i] = states.states[candidates[i].index];
+
+    return selectedCount;
+}
+
+void SearchEngine::buildActionTable() {
+    for (int i = 0; i < orderCount; ++i)
+        actions[i] = &orders[i];
+    for (int i = 0; i < recipeCount; ++i)
+        actions[MAX_ORDER_COUNT + i] = &recipes[i];
+    actions[REST_ACTION] = &rest;
+
+    int castCount = 0;
+    for (int i = 0; i < spellCount; ++i) {
+        spellCastSlots[i] = castCount;
+        for (int j = 0; j < spells[i].maxTimes; ++j) {
+            auto& cast = casts[castCount];
+            cast = spells[i];
+            cast.curTimes = j + 1;
+            actions[FIRST_CAST_ACTION + castCount++] = &cast;
+        }
+    }
+}
+
+void SearchEngine::buildTransitions() {
+    transitionStride = 0;
+    for (int i = 0; i < spellCount; ++i) {
+        spellCastSlots[i] = transitionStride;
+        transitionStride += spells[i].maxTimes;
+    }
+    for (int i = 0; i < recipeCount; ++i) {
+        recipeCastSlots[i] = transitionStride;
+        transitionStride += spellsFromRecipes[i].maxTimes;
+    }
+    orderSlot = transitionStride;
+    transitionStride += orderCount;
+    // every cast and order slot, learning each recipe, and rest
+    maxNeighbors = transitionStride + recipeCount + 1;
+
+    slotDeltas.clear();
+    for (int i = 0; i < spellCount; ++i)
+        for (int j = 0; j < spells[i].maxTimes; ++j)
+            slotDeltas.push_back(spells[i].repeatedDeltas[j]);
+    for (int i = 0; i < recipeCount; ++i)
+        for (int j = 0; j < spellsFromRecipes[i].maxTimes; ++j)
+            slotDeltas.push_back(spellsFromRecipes[i].repeatedDeltas[j]);
+    for (int i = 0; i < orderCount; ++i)
+        slotDeltas.push_back(orders[i].delta);
+    assert(int(slotDeltas.size()) == transitionStride);
+    slotBatch.assign(slotDeltas);
+
+    applicable.resize(slotBatch.maskWords());
+    transitions.resize(Inventory::COUNT * transitionStride);
+    for (inv_t inv = 0; inv < Inventory::COUNT; ++inv) {
+        const Delta& from = Inventory::delta(inv);
+        inv_t* row = transitions.data() + inv * transitionStride;
+        std::fill(row, row + transitionStride, Inventory::NONE);
+
+        slotBatch.applicable(from, applicable.data());
+        for (int w = 0; w < int(applicable.size()); ++w)
+            for (uint64_t mask = applicable[w]; mask; mask &= mask - 1) {
+                int k = 64 * w + __builtin_ctzll(mask);
+                row[k] = Inventory::index(from + slotDeltas[k]);
+            }
+    }
+}
+
+// Multi-source BFS backwards from the inventories affording each order,
+// over the cast edges of the transition table.
+void SearchEngine::buildOrderDistances() {
+    int spellCastCount = recipeCount > 0 ? recipeCastSlots[0] : orderSlot;
+
+    predecessorBegin.assign(Inventory::COUNT + 1, 0);
+    for (inv_t inv = 0; inv < Inventory::COUNT; ++inv) {
+        const inv_t* row = transitionRow(inv);
+        for (int k = 0; k < spellCastCount; ++k)
+            if (row[k] != Inventory::NONE)
+                ++predecessorBegin[row[k] + 1];
+    }
+    for (int inv = 0; inv < Inventory::COUNT; ++inv)
+        predecessorBegin[inv + 1] += predecessorBegin[inv];
+
+    predecessors.resize(predecessorBegin[Inventory::COUNT]);
+    predecessorEnd.assign(predecessorBegin.begin(), predecessorBegin.end() - 1);
+    for (inv_t inv = 0; inv < Inventory::COUNT; ++inv) {
+        const inv_t* row = transitionRow(inv);
+        for (int k = 0; k < spellCastCount; ++k)
+            if (row[k] != Inventory::NONE)
+                predecessors[predecessorEnd[row[k]]++] = inv;
+    }
+
+    orderDistances.assign(Inventory::COUNT * MAX_ORDER_COUNT, UNREACHABLE);
+    orderQueue.resize(Inventory::COUNT);
+    for (int i = 0; i < orderCount; ++i) {
+        auto distance = [this, i](const inv_t& inv) -> uint8_t& {
+            return orderDistances[inv * MAX_ORDER_COUNT + i];
+        };
+
+        int head = 0, tail = 0;
+        for (inv_t inv = 0; inv < Inventory::COUNT; ++inv)
+            if (transitionRow(inv)[orderSlot + i] != Inventory::NONE) {
+                distance(inv) = 0;
+                orderQueue[tail++] = inv;
+            }
 
-    assert(customSpellCount <= MAX_SPELL_COUNT);
+        while (head < tail) {
+            inv_t inv = orderQueue[head++];
+            if (distance(inv) + 1 >= UNREACHABLE)
+                continue;
+            for (int k = predecessorBegin[inv]; k < predecessorBegin[inv + 1]; ++k) {
+                inv_t previous = predecessors[k];
+                if (distance(previous) == UNREACHABLE) {
+                    distance(previous) = distance(inv) + 1;
+                    orderQueue[tail++] = previous;
+                }
+            }
+        }
+    }
+}
 
-    return finalState.firstAction;
+// Forward BFS from the opponent's inventory over its own casts, reading
+// off the first layer that affords each order.
+void SearchEngine::buildRivalBrewTurns() {
+    rivalDistances.assign(Inventory::COUNT, UNREACHABLE);
+    rivalQueue.resize(Inventory::COUNT);
+    rivalBrewTurns.fill(UNREACHABLE);
+
+    int head = 0, tail = 0;
+    inv_t start = Inventory::index(opponent.inv);
+    rivalDistances[start] = 0;
+    rivalQueue[tail++] = start;
+
+    while (head < tail) {
+        inv_t inv = rivalQueue[head++];
+        const Delta& from = Inventory::delta(inv);
+        for (int i = 0; i < orderCount; ++i)
+            if (rivalBrewTurns[i] == UNREACHABLE && from.canApply(orders[i].delta))
+                rivalBrewTurns[i] = rivalDistances[inv] + 1;
+
+        if (rivalDistances[inv] + 2 >= UNREACHABLE)
+            continue;
+        for (int i = 0; i < opponentSpellCount; ++i)
+            for (int j = 0; j < opponentSpells[i].maxTimes; ++j) {
+                const Delta& delta = opponentSpells[i].repeatedDeltas[j];
+                if (!from.canApply(delta))
+                    break;
+                inv_t next = Inventory::index(from + delta);
+                if (rivalDistances[next] == UNREACHABLE) {
+                    rivalDistances[next] = rivalDistances[inv] + 1;
+                    rivalQueue[tail++] = next;
+                }
+            }
+    }
 }
 
-State Battle::getInitialState() {
+State SearchEngine::getInitialState() const {
     State initialState;
-    initialState.player.inv = player.inv;
-    initialState.player.score = 0;
+    initialState.inv = Inventory::index(player.inv);
+    initialState.score = 0;
 
     initialState.castableSpellsMask = 0;
     for (int i = 0; i < spellCount; ++i)
@@ -775,19 +2074,1203 @@ State Battle::getInitialState() {
     initialState.castableSpellsFromRecipesMask = (1 << recipeCount) - 1;
     initialState.gamma = 1.f;
 
-    initialState.evaluation = initialState.player.inv.eval() +
-        __builtin_popcount(initialState.castableSpellsMask) * 0.01f;
+    initialState.evaluation = rootEvaluation(initialState);
+    initialState.discounted = 0;
 
     initialState.ordersDone = playerOrdersDone;
     initialState.recipesLearnt = recipeDoneCount;
+    initialState.firstAction = NO_ACTION;
+    initialState.secondAction = NO_ACTION;
+    initialState.depth = 0;
 
     return initialState;
 }
 
-int main() {
+eval_t SearchEngine::rootEvaluation(const State& s) const {
+    return Inventory::eval(s.inv) + __builtin_popcount(s.castableSpellsMask) * params.castableValue;
+}
+
+std::string SearchEngine::describe(const State& s) const {
+    std::ostringstream out;
+    out << "inv=" << Inventory::delta(s.inv) << ", score=" << s.score << "\n";
+    out << "gamma=" << s.gamma << "\n";
+    out << "evaluation=" << s.evaluation << "\n";
+    out << "ordersDone=" << s.ordersDone << "\n";
+    out << "recipesLearnt=" << s.recipesLearnt << "\n";
+
+    out << "SPELLS:\n";
+    for (int i = 0; i < spellCount; ++i) {
+        out << "\t" << (s.isCastable(i) ? "CASTABLE" : "NONCASTABLE") << " ";
+        out << spells[i] << "\n";
+    }
+
+    out << "ORDERS:\n";
+    for (int i = 0; i < orderCount; ++i) {
+        out << "\t" << (s.isOrderDoable(i) ? "DOABLE" : "DONE") << " ";
+        out << orders[i] << "\n";
+    }
+
+    out << "RECIPES:\n";
+    for (int i = 0; i < recipeCount; ++i) {
+        out << "\t" << (s.isRecipeDoable(i) ? "DOABLE" : "DONE") << " ";
+        out << recipes[i] << "\n";
+    }
+
+    return out.str();
+}
+
+// Beam.cpp
+
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+
+Beam::~Beam() {
+    std::free(block);
+}
+
+void Beam::reserve(const int& capacity) {
+    if (capacity <= size)
+        return;
+
+    auto arraySize = [capacity](const size_t& fieldSize) {
+        return (capacity * fieldSize + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    };
+    size_t total = arraySize(sizeof(State)) + arraySize(sizeof(uint64_t)) +
+        arraySize(sizeof(eval_t));
+
+    std::free(block);
+    block = std::aligned_alloc(ALIGNMENT, total);
+    if (!block)
+        throw std::bad_alloc();
+    size = capacity;
+
+    char* next = static_cast<char*>(block);
+    auto carve = [&](auto*& array) {
+        using T = std::remove_reference_t<decltype(*array)>;
+        array = reinterpret_cast<T*>(next);
+        next += arraySize(sizeof(T));
+    };
+    carve(states);
+    carve(keys);
+    carve(evaluations);
+}
+
+int Beam::capacity() const {
+    return size;
+}
+
+// Common.cpp
+
+Timer::Timer(float timeLimit) :
+	timeLimit(timeLimit), startTime(Clock::now()) {
+
+}
+
+Timer::Timer(float timeLimit, const Clock::time_point& startTime) :
+	timeLimit(timeLimit), startTime(startTime) {
+
+}
+
+bool Timer::isTimeLeft() const {
+	return elapsed() < timeLimit;
+}
+
+float Timer::elapsed() const {
+	auto now = Clock::now();
+	return std::chrono::duration<float>(now - startTime).count() * 1000;
+}
+
+float Timer::limit() const {
+	return timeLimit;
+}
+
+// Delta.cpp
+
+#include <cassert>
+
+Delta::Delta(const int& d0, const int& d1, const int& d2, const int& d3) :
+    packed(uint8_t(d0) | uint8_t(d1) << 8 | uint8_t(d2) << 16 | uint32_t(uint8_t(d3)) << 24) {
+
+    assert((*this)[0] == d0 && (*this)[1] == d1 && (*this)[2] == d2 && (*this)[3] == d3);
+}
+
+std::istream& operator>>(std::istream& in, Delta& d) {
+    int d0, d1, d2, d3;
+    in >> d0 >> d1 >> d2 >> d3;
+    d = Delta(d0, d1, d2, d3);
+    return in;
+}
+
+std::ostream& operator<<(std::ostream& out, const Delta& o) {
+    return out << "{" << o[0] << "," << o[1] << ","
+               << o[2] << "," << o[3] << "}";
+}
+
+// DeltaBatch.cpp
+
+#include <algorithm>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+void DeltaBatch::assign(const std::vector<Delta>& deltas) {
+    count = int(deltas.size());
+    int padded = (count + WIDTH - 1) / WIDTH * WIDTH;
+    packed.assign(padded, 0);
+    sums.assign(padded, Delta::MAX_INVENTORY + 1);
+    for (int k = 0; k < count; ++k) {
+        packed[k] = deltas[k].packed;
+        sums[k] = deltas[k].sum();
+    }
+}
+
+int DeltaBatch::size() const {
+    return count;
+}
+
+int DeltaBatch::maskWords() const {
+    return (count + 63) / 64;
+}
+
+const char* DeltaBatch::kernel() {
+    return variant().name;
+}
+
+const DeltaBatch::Variant& DeltaBatch::variant() {
+    static const Variant chosen = pick();
+    return chosen;
+}
+
+DeltaBatch::Variant DeltaBatch::pick() {
+#ifdef __x86_64__
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return { "AVX-512", applicableAvx512 };
+    if (__builtin_cpu_supports("avx2"))
+        return { "AVX2", applicableAvx2 };
+    if (__builtin_cpu_supports("sse4.2"))
+        return { "SSE4.2", applicableSse42 };
+#endif
+    return { "scalar", applicableScalar };
+}
+
+// In every kernel lanes of inv + delta stay within [-10, 20], so byte
+// additions can't wrap and a negative lane is one with its sign bit set.
+// Each mask word is built in a register from the steps it covers and
+// stored once.
+
+#ifdef __x86_64__
+__attribute__((target("avx512f,avx512bw")))
+void DeltaBatch::applicableAvx512(const DeltaBatch& batch, const Delta& inv, uint64_t* masks) {
+    STATS_COUNT(LEGALITY_CHECKS, batch.count);
+    const __m512i inventory = _mm512_set1_epi32(int(inv.packed));
+    const __m512i room = _mm512_set1_epi32(Delta::MAX_INVENTORY - inv.sum());
+    const __m512i signs = _mm512_set1_epi32(int(Delta::LANE_GUARD));
+    const int padded = int(batch.packed.size());
+    for (int word = 0; 64 * word < padded; ++word) {
+        uint64_t mask = 0;
+        for (int k = 64 * word; k < std::min(padded, 64 * (word + 1)); k += 16) {
+            __m512i deltas = _mm512_loadu_si512(batch.packed.data() + k);
+            __m512i deltaSums = _mm512_loadu_si512(batch.sums.data() + k);
+            __mmask16 negative = _mm512_test_epi32_mask(_mm512_add_epi8(inventory, deltas), signs);
+            __mmask16 full = _mm512_cmpgt_epi32_mask(deltaSums, room);
+            mask |= uint64_t(uint16_t(~(negative | full))) << (k % 64);
+        }
+        masks[word] = mask;
+    }
+}
+
+__attribute__((target("avx2")))
+void DeltaBatch::applicableAvx2(const DeltaBatch& batch, const Delta& inv, uint64_t* masks) {
+    STATS_COUNT(LEGALITY_CHECKS, batch.count);
+    const __m256i inventory = _mm256_set1_epi32(int(inv.packed));
+    const __m256i room = _mm256_set1_epi32(Delta::MAX_INVENTORY - inv.sum());
+    const __m256i zero = _mm256_setzero_si256();
+    const int padded = int(batch.packed.size());
+    for (int word = 0; 64 * word < padded; ++word) {
+        uint64_t mask = 0;
+        for (int k = 64 * word; k < std::min(padded, 64 * (word + 1)); k += 8) {
+            __m256i deltas = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(batch.packed.data() + k));
+            __m256i deltaSums = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(batch.sums.data() + k));
+            __m256i negativeLanes = _mm256_cmpgt_epi8(zero, _mm256_add_epi8(inventory, deltas));
+            __m256i nonNegative = _mm256_cmpeq_epi32(negativeLanes, zero);
+            __m256i legal = _mm256_andnot_si256(_mm256_cmpgt_epi32(deltaSums, room), nonNegative);
+            mask |= uint64_t(uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(legal)))) << (k % 64);
+        }
+        masks[word] = mask;
+    }
+}
+
+__attribute__((target("sse4.2")))
+void DeltaBatch::applicableSse42(const DeltaBatch& batch, const Delta& inv, uint64_t* masks) {
+    STATS_COUNT(LEGALITY_CHECKS, batch.count);
+    const __m128i inventory = _mm_set1_epi32(int(inv.packed));
+    const __m128i room = _mm_set1_epi32(Delta::MAX_INVENTORY - inv.sum());
+    const __m128i zero = _mm_setzero_si128();
+    const int padded = int(batch.packed.size());
+    for (int word = 0; 64 * word < padded; ++word) {
+        uint64_t mask = 0;
+        for (int k = 64 * word; k < std::min(padded, 64 * (word + 1)); k += 4) {
+            __m128i deltas = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(batch.packed.data() + k));
+            __m128i deltaSums = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(batch.sums.data() + k));
+            __m128i negativeLanes = _mm_cmpgt_epi8(zero, _mm_add_epi8(inventory, deltas));
+            __m128i nonNegative = _mm_cmpeq_epi32(negativeLanes, zero);
+            __m128i legal = _mm_andnot_si128(_mm_cmpgt_epi32(deltaSums, room), nonNegative);
+            mask |= uint64_t(uint32_t(_mm_movemask_ps(_mm_castsi128_ps(legal)))) << (k % 64);
+        }
+        masks[word] = mask;
+    }
+}
+#endif
+
+void DeltaBatch::applicableScalar(const DeltaBatch& batch, const Delta& inv, uint64_t* masks) {
+    for (int word = 0; 64 * word < batch.count; ++word) {
+        uint64_t mask = 0;
+        for (int k = 64 * word; k < std::min(batch.count, 64 * (word + 1)); ++k) {
+            Delta delta;
+            delta.packed = batch.packed[k];
+            mask |= uint64_t(inv.canApply(delta)) << (k % 64);
+        }
+        masks[word] = mask;
+    }
+}
+
+// Action.cpp
+
+#include <cassert>
+
+Action::Action(const int& id, const Delta& delta) :
+    delta(delta), id(id) {
+
+}
+
+Order::Order(const int& id, const Delta& delta, const int& price) :
+    Action(id, delta), price(price) {
+
+}
+
+void Order::print(std::ostream& out) const {
+    out << "BREW " << id << std::endl;
+}
+
+std::ostream& operator<<(std::ostream& out, const Order& o) {
+    return out << "ORDER: id=" << o.id 
+        << ", delta=" << o.delta << ", "
+        << "price=" << o.price;
+}
+
+Recipe::Recipe(const int& id, const Delta& delta,
+    const int& tomeIndex, const int& taxCount, const bool& repeatable) :
+    Action(id, delta), tomeIndex(tomeIndex), taxCount(taxCount), repeatable(repeatable) {
+
+}
+
+void Recipe::print(std::ostream& out) const {
+    out << "LEARN " << id << std::endl;
+}
+
+std::ostream& operator<<(std::ostream& out, const Recipe& r) {
+    return out << "RECIPE: id=" << r.id 
+        << ", delta={" << r.delta << ", "
+        << "tomeIndex=" << r.tomeIndex << ", "
+        << "taxCount=" << r.taxCount << ", "
+        << "repeatable=" << r.repeatable;
+}
+
+Spell::Spell(const int& id, const Delta& delta,
+    const bool& castable, const bool& repeatable) :
+    Action(id, delta), castable(castable), repeatable(repeatable) {
+
+    if (repeatable) {
+        int provide = 0, supply = 0;
+        for (int i = 0; i < 4; ++i)
+            if (delta[i] < 0)
+                provide -= delta[i];
+            else
+                supply += delta[i];
+
+        assert(provide >= 0 && supply >= 0);
+
+        maxTimes = 10;
+        if (provide > 0)
+            maxTimes = std::min(maxTimes, 10 / provide);
+        if (supply > 0)
+            maxTimes = std::min(maxTimes, 10 / supply);
+    }
+
+    assert(maxTimes <= MAX_REPEATED_DELTA);
+
+    repeatedDeltas[0] = delta;
+    for (int i = 1; i < maxTimes; ++i)
+        repeatedDeltas[i] = repeatedDeltas[i - 1] + delta;
+}
+
+Spell::Spell(const Recipe& recipe) :
+    Spell(recipe.id, recipe.delta, true, recipe.repeatable) {
+
+}
+
+void Spell::print(std::ostream& out) const {
+    assert(curTimes >= 1);
+    out << "CAST " << id << " " << curTimes << std::endl;
+}
+
+std::ostream& operator<<(std::ostream& out, const Spell& s) {
+    return out << "SPELL: id=" << s.id 
+        << ", delta=" << s.delta << ", "
+        << "castable=" << s.castable << ", "
+        << "maxTimes=" << s.maxTimes;
+}
+
+void Rest::print(std::ostream& out) const {
+    out << "REST" << std::endl;
+}
+
+std::istream& operator>>(std::istream& in, Witch& w) {
+    return in >> w.inv >> w.score;
+}
+
+std::ostream& operator<<(std::ostream& out, const Witch& w) {
+    return out << "delta=" << w.inv << ", " << "score=" << w.score;
+}
+
+// Inventory.cpp
+
+#include <cassert>
+
+const Inventory::Tables Inventory::tables;
+
+Inventory::Tables::Tables() {
+    indices.fill(NONE);
+
+    int count = 0;
+    for (int a = 0; a <= Delta::MAX_INVENTORY; ++a)
+        for (int b = 0; a + b <= Delta::MAX_INVENTORY; ++b)
+            for (int c = 0; a + b + c <= Delta::MAX_INVENTORY; ++c)
+                for (int d = 0; a + b + c + d <= Delta::MAX_INVENTORY; ++d) {
+                    Delta inv(a, b, c, d);
+                    deltas[count] = inv;
+                    evals[count] = inv.eval();
+                    indices[code(inv)] = count;
+                    ++count;
+                }
+
+    assert(count == COUNT);
+}
+
+// Log.cpp
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <streambuf>
+#include <string>
+
+namespace {
+    struct Slot {
+        std::atomic<size_t> sequence;
+        size_t length;
+        char text[Log::SLOT_SIZE];
+    };
+
+    // A bounded multi-producer queue after Vyukov: the writer holding
+    // ticket t owns slot t % SLOT_COUNT once its sequence is t, and the
+    // message is readable once the sequence is t + 1. Only flush() reads,
+    // under its own mutex, and hands the slot back for ticket
+    // t + SLOT_COUNT.
+    class Ring {
+    public:
+        Ring() {
+            for (size_t i = 0; i < Log::SLOT_COUNT; ++i)
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        ~Ring() {
+            drain();
+        }
+
+        void push(const char* text, const size_t& length) {
+            size_t ticket = head.load(std::memory_order_relaxed);
+            Slot* slot;
+            while (true) {
+                slot = &slots[ticket % Log::SLOT_COUNT];
+                size_t sequence = slot->sequence.load(std::memory_order_acquire);
+                intptr_t lag = intptr_t(sequence) - intptr_t(ticket);
+                if (lag == 0) {
+                    if (head.compare_exchange_weak(ticket, ticket + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (lag < 0) {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                else
+                    ticket = head.load(std::memory_order_relaxed);
+            }
+
+            slot->length = std::min(length, size_t(Log::SLOT_SIZE));
+            std::memcpy(slot->text, text, slot->length);
+            slot->sequence.store(ticket + 1, std::memory_order_release);
+        }
+
+        void drain() {
+            std::lock_guard<std::mutex> lock(reading);
+            pending.clear();
+            while (true) {
+                Slot& slot = slots[tail % Log::SLOT_COUNT];
+                if (slot.sequence.load(std::memory_order_acquire) != tail + 1)
+                    break;
+                pending.append(slot.text, slot.length);
+                slot.sequence.store(tail + Log::SLOT_COUNT, std::memory_order_release);
+                ++tail;
+            }
+
+            size_t lost = dropped.exchange(0, std::memory_order_relaxed);
+            if (lost)
+                pending += "log: " + std::to_string(lost) + " messages dropped\n";
+            if (!pending.empty()) {
+                std::fwrite(pending.data(), 1, pending.size(), stderr);
+                std::fflush(stderr);
+            }
+        }
+
+    private:
+        Slot slots[Log::SLOT_COUNT];
+        alignas(64) std::atomic<size_t> head { 0 };
+        alignas(64) std::atomic<size_t> dropped { 0 };
+        std::mutex reading;
+        size_t tail = 0;
+        std::string pending;
+    };
+
+    Ring ring;
+
+    // Formats into a fixed array; what doesn't fit is cut off.
+    class SlotBuffer : public std::streambuf {
+    public:
+        SlotBuffer() {
+            reset();
+        }
+
+        void reset() {
+            setp(text, text + Log::SLOT_SIZE);
+        }
+
+        char* data() {
+            return pbase();
+        }
+
+        size_t size() const {
+            return pptr() - pbase();
+        }
+
+    private:
+        char text[Log::SLOT_SIZE];
+    };
+
+    struct Formatter {
+        SlotBuffer buffer;
+        std::ostream out { &buffer };
+    };
+
+    Formatter& formatter() {
+        thread_local Formatter f;
+        return f;
+    }
+}
+
+void Log::append(const char* text, const size_t& length) {
+    ring.push(text, length);
+}
+
+void Log::flush() {
+    ring.drain();
+}
+
+std::ostream& Log::begin() {
+    Formatter& f = formatter();
+    f.buffer.reset();
+    f.out.clear();
+    return f.out;
+}
+
+void Log::end() {
+    Formatter& f = formatter();
+    size_t size = f.buffer.size();
+    // a message cut short still ends its line
+    if (size == SLOT_SIZE)
+        f.buffer.data()[size - 1] = '\n';
+    append(f.buffer.data(), size);
+}
+
+// Mcts.cpp
+
+#include <cassert>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void MctsStats::reset() {
+    iterations = 0;
+    nodes = depth = reused = 0;
+    time = overshoot = 0;
+    firstAction = SearchEngine::NO_ACTION;
+}
+
+Mcts::Mcts(SearchEngine& engine) :
+    engine(engine) {
+
+}
+
+void Mcts::forget() {
+    played = -1;
+}
+
+const Action* Mcts::search(float timeLimit, long long maxIterations) {
+    return search(Timer(timeLimit), maxIterations);
+}
+
+const Action* Mcts::search(const Timer& timer, long long maxIterations) {
+    reserveArena();
+    State initialState = engine.getInitialState();
+    stats.reset();
+    if (reuseTree(initialState))
+        stats.reused = nodes[root].visits;
+    else {
+        root = 0;
+        nodeCount = 1;
+        nodes[root] = { 0, 0, 0, 0, 0 };
+        states[root] = initialState;
+        minReward = maxReward = initialState.leafEvaluation(engine);
+    }
+
+    // The root is always expanded and every child played out once, so
+    // there is an answer however short the budget.
+    if (nodes[root].childCount == 0)
+        expand(root);
+    long long iterations = 0;
+    while (iterations < maxIterations &&
+        (iterations < nodes[root].childCount || iterations % TIME_CHECK_INTERVAL ||
+            timer.isTimeLeft())) {
+
+        path.assign(1, root);
+        int node = root;
+        while (nodes[node].childCount > 0) {
+            node = selectChild(node);
+            path.push_back(node);
+            if (nodes[node].visits == 0)
+                break;
+        }
+        if (nodes[node].visits > 0 && expand(node)) {
+            node = nodes[node].firstChild;
+            path.push_back(node);
+        }
+
+        backpropagate(rollout(states[node]));
+        stats.depth = std::max(stats.depth, int(path.size()) - 1);
+        ++iterations;
+    }
+
+    const Node& r = nodes[root];
+    assert(r.childCount > 0);
+    int best = r.firstChild;
+    for (int i = r.firstChild; i < r.firstChild + r.childCount; ++i)
+        if (nodes[i].visits > nodes[best].visits ||
+            (nodes[i].visits == nodes[best].visits &&
+                nodes[i].value * nodes[best].visits > nodes[best].value * nodes[i].visits))
+            best = i;
+
+    stats.iterations = iterations;
+    stats.nodes = nodeCount;
+    stats.time = timer.elapsed();
+    stats.overshoot = stats.time - timer.limit();
+    stats.firstAction = states[best].secondAction;
+
+    played = best;
+    playedSignature = engine.tableSignature();
+    assert(states[best].secondAction < SearchEngine::UNKNOWN_ACTION);
+    return engine.actions[states[best].secondAction];
+}
+
+// Nodes outside the kept subtree are only reclaimed by starting over,
+// which happens once they fill half the arena.
+bool Mcts::reuseTree(const State& initialState) {
+    bool reusable = engine.reuseSearch && played != -1 &&
+        playedSignature == engine.tableSignature() &&
+        states[played].key() == initialState.key() &&
+        nodeCount <= MAX_NODES / 2;
+    if (reusable) {
+        root = played;
+        reroot();
+    }
+    played = -1;
+    return reusable;
+}
+
+// Re-expresses the kept subtree as searched from its root, like the beam's
+// carried states, so its rewards compare with this turn's. Each node
+// keeps the part of its rewards gamma weighed apart, so their sums rebase
+// as evaluations do. Only the rebased means bound the range of rewards
+// until new ones come in.
+void Mcts::reroot() {
+    const State next = states[root];
+    eval_t nextRootEvaluation = engine.rootEvaluation(next);
+    eval_t shift = nextRootEvaluation - (next.evaluation - next.discounted);
+    float decay = engine.params.decay;
+
+    minReward = std::numeric_limits<eval_t>::max();
+    maxReward = std::numeric_limits<eval_t>::lowest();
+    path.assign(1, root);
+    while (!path.empty()) {
+        int node = path.back();
+        path.pop_back();
+        engine.reroot(states[node], next, nextRootEvaluation);
+
+        Node& n = nodes[node];
+        eval_t undiscounted = n.value - n.discounted;
+        n.discounted = (n.discounted - n.visits * next.discounted) / decay;
+        n.value = undiscounted + n.visits * shift + n.discounted;
+        if (n.visits > 0) {
+            minReward = std::min(minReward, n.value / n.visits);
+            maxReward = std::max(maxReward, n.value / n.visits);
+        }
+
+        for (int i = n.firstChild; i < n.firstChild + n.childCount; ++i)
+            path.push_back(i);
+    }
+}
+
+void Mcts::reserveArena() {
+    if (int(nodes.size()) < MAX_NODES) {
+        nodes.resize(MAX_NODES);
+        states.resize(MAX_NODES);
+    }
+    if (int(playout.size()) < engine.maxNeighbors)
+        playout.resize(engine.maxNeighbors);
+}
+
+// UCB1 with values scaled to [0, 1] by the range of rewards seen so far,
+// since evaluations aren't bounded. Unvisited children go first.
+int Mcts::selectChild(const int& parent) {
+    STATS_TIME(SELECT);
+    STATS_COUNT(SELECTIONS, 1);
+    const Node& p = nodes[parent];
+    eval_t range = maxReward - minReward;
+    float logVisits = std::log(float(p.visits));
+    float exploration = engine.params.exploration;
+
+    int best = -1;
+    float bestScore = -1;
+    for (int i = p.firstChild; i < p.firstChild + p.childCount; ++i) {
+        const Node& child = nodes[i];
+        if (child.visits == 0)
+            return i;
+        float mean = child.value / child.visits;
+        float exploitation = range > 0 ? (mean - minReward) / range : 0.5f;
+        float score = exploitation + exploration * std::sqrt(logVisits / child.visits);
+        if (score > bestScore) {
+            bestScore = score;
+            best = i;
+        }
+    }
+
+    assert(best != -1);
+    return best;
+}
+
+// Generates the children of node straight into the arena. Returns false,
+// leaving node a leaf, once the arena can't fit another expansion or node
+// is as deep as the game goes.
+bool Mcts::expand(const int& node) {
+    if (nodeCount + engine.maxNeighbors > MAX_NODES ||
+        states[node].depth >= engine.roundsLeft())
+        return false;
+
+    State parent = states[node];
+    parent.firstAction = SearchEngine::TREE_ACTION;
+    parent.secondAction = SearchEngine::NO_ACTION;
+    int childCount = parent.getNeighbors(engine, states.data() + nodeCount);
+    assert(childCount > 0 && childCount <= engine.maxNeighbors);
+    nodes[node].firstChild = nodeCount;
+    nodes[node].childCount = childCount;
+    for (int i = nodeCount; i < nodeCount + childCount; ++i)
+        nodes[i] = { 0, 0, 0, 0, 0 };
+    nodeCount += childCount;
+    return true;
+}
+
+State Mcts::rollout(const State& state) {
+    State current = state;
+    int maxDepth = engine.roundsLeft();
+    for (int d = 0; d < ROLLOUT_DEPTH && current.depth < maxDepth; ++d) {
+        int childCount = current.getNeighbors(engine, playout.data());
+        current = playout[random() % childCount];
+    }
+    return current;
+}
+
+void Mcts::backpropagate(const State& leaf) {
+    eval_t reward = leaf.leafEvaluation(engine);
+    eval_t discounted = reward - (leaf.evaluation - leaf.discounted);
+    minReward = std::min(minReward, reward);
+    maxReward = std::max(maxReward, reward);
+    for (const int& node : path) {
+        ++nodes[node].visits;
+        nodes[node].value += reward;
+        nodes[node].discounted += discounted;
+    }
+}
+
+// Options.cpp
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+int Options::enemyOrdersDone = 0;
+
+Options::Params Options::params = Options::DEFAULTS;
+
+namespace {
+	struct Field {
+		const char* name;
+		float Options::Params::* real;
+		int Options::Params::* integer;
+		// read by the move generators or the leaf evaluation, which
+		// Compiled fixes to DEFAULTS
+		bool compiled;
+	};
+
+	const Field fields[] = {
+		{ "decay", &Options::Params::decay, nullptr, true },
+		{ "learnDecay", &Options::Params::learnDecay, nullptr, true },
+		{ "nearOrderWeight", &Options::Params::nearOrderWeight, nullptr, true },
+		{ "rivalDiscount", &Options::Params::rivalDiscount, nullptr, true },
+		{ "lastOrderBonus", &Options::Params::lastOrderBonus, nullptr, true },
+		{ "castableValue", &Options::Params::castableValue, nullptr, true },
+		{ "exploration", &Options::Params::exploration, nullptr, false },
+		{ "beamWidth", nullptr, &Options::Params::beamWidth, false },
+	};
+
+	// decay -> WITCH_DECAY, learnDecay -> WITCH_LEARN_DECAY
+	std::string environmentName(const char* name) {
+		std::string result = "WITCH_";
+		for (const char* c = name; *c; ++c) {
+			if (std::isupper(*c))
+				result += '_';
+			result += char(std::toupper(*c));
+		}
+		return result;
+	}
+}
+
+bool Options::set(const char* name, const char* value) {
+	for (const auto& field : fields) {
+		if (std::strcmp(field.name, name))
+			continue;
+
+		char* end;
+		if (field.real)
+			params.*field.real = std::strtof(value, &end);
+		else
+			params.*field.integer = int(std::strtol(value, &end, 10));
+		if (end == value || *end) {
+			std::cerr << "options: bad value " << value << " for " << name << "\n";
+			return false;
+		}
+		return true;
+	}
+
+	std::cerr << "options: unknown parameter " << name << "\n";
+	return false;
+}
+
+// Lines of "name value"; anything after # is a comment.
+bool Options::loadFile(const char* path) {
+	std::ifstream file(path);
+	if (!file) {
+		std::cerr << "options: cannot open " << path << "\n";
+		return false;
+	}
+
+	bool ok = true;
+	for (std::string line; std::getline(file, line); ) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream in(line);
+		std::string name, value;
+		if (in >> name >> value)
+			ok &= set(name.c_str(), value.c_str());
+	}
+	return ok;
+}
+
+bool Options::loadEnvironment() {
+	bool ok = true;
+	for (const auto& field : fields)
+		if (const char* value = std::getenv(environmentName(field.name).c_str()))
+			ok &= set(field.name, value);
+	return ok;
+}
+
+void Options::update() {
+	params.derive();
+}
+
+bool Options::isDefault(const Params& p) {
+	for (const auto& field : fields)
+		if (field.compiled && (field.real ? p.*field.real != DEFAULTS.*field.real :
+			p.*field.integer != DEFAULTS.*field.integer))
+			return false;
+	return true;
+}
+
+void Options::print(std::ostream& out) {
+	for (const auto& field : fields) {
+		out << field.name << " ";
+		if (field.real)
+			out << params.*field.real << "\n";
+		else
+			out << params.*field.integer << "\n";
+	}
+}
+
+// Reader.cpp
+
+#include <cerrno>
+#include <unistd.h>
+
+Reader::Reader(const int& fd) :
+    fd(fd), pos(buffer), end(buffer) {
+
+}
+
+Reader::Reader(const char* begin, const char* end) :
+    fd(-1), pos(begin), end(end) {
+
+}
+
+bool Reader::refill() {
+    if (fd < 0)
+        return false;
+
+    ssize_t count;
+    do
+        count = read(fd, buffer, BUFFER_SIZE);
+    while (count < 0 && errno == EINTR);
+
+    if (count <= 0)
+        return false;
+    pos = buffer;
+    end = buffer + count;
+    return true;
+}
+
+void Reader::skipWhitespace() {
+    while (fill() && unsigned(*pos) <= ' ')
+        ++pos;
+}
+
+bool Reader::eof() {
+    skipWhitespace();
+    return pos == end;
+}
+
+int Reader::readInt() {
+    skipWhitespace();
+
+    bool negative = fill() && *pos == '-';
+    if (negative)
+        ++pos;
+
+    int value = 0;
+    while (fill() && unsigned(*pos - '0') < 10)
+        value = value * 10 + (*pos++ - '0');
+    return negative ? -value : value;
+}
+
+char Reader::readKeyword() {
+    skipWhitespace();
+    if (!fill())
+        return '\0';
+
+    char first = *pos;
+    while (fill() && unsigned(*pos) > ' ')
+        ++pos;
+    return first;
+}
+
+// Snapshot.cpp
+
+#include <cassert>
+
+void Snapshot::read(Reader& in) {
+    STATS_TIME(PARSE);
+    auto readDelta = [&in] {
+        int d0 = in.readInt(), d1 = in.readInt();
+        int d2 = in.readInt(), d3 = in.readInt();
+        return Delta(d0, d1, d2, d3);
+    };
+
+    orders.clear();
+    recipes.clear();
+    spells.clear();
+    opponentSpells.clear();
+
+    int actionCount = in.readInt();
+    while (actionCount--) {
+        int actionId = in.readInt();
+        char actionType = in.readKeyword();
+        Delta delta = readDelta();
+
+        int price = in.readInt();
+        int tomeIndex = in.readInt();
+        int taxCount = in.readInt();
+        bool castable = in.readInt();
+        bool repeatable = in.readInt();
+
+        switch (actionType) {
+            case 'B': // BREW
+                orders.emplace_back(actionId, delta, price);
+                break;
+            case 'C': // CAST
+                spells.emplace_back(actionId, delta, castable, repeatable);
+                break;
+            case 'L': // LEARN
+                recipes.emplace_back(actionId, delta, tomeIndex, taxCount, repeatable);
+                break;
+            default:
+                assert(actionType == 'O'); // OPPONENT_CAST
+                opponentSpells.emplace_back(actionId, delta, castable, repeatable);
+        }
+    }
+
+    player.inv = readDelta();
+    player.score = in.readInt();
+    opponent.inv = readDelta();
+    opponent.score = in.readInt();
+}
+
+// Stats.cpp
+
+#ifdef STATS
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace {
+    std::mutex mutex;
+    std::vector<Stats::Counters*> threads;
+    // left behind by threads that have ended since the last collect()
+    Stats::Counters retired;
+
+    struct Registration {
+        Stats::Counters counters;
+
+        Registration() {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.push_back(&counters);
+        }
+
+        ~Registration() {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.erase(std::find(threads.begin(), threads.end(), &counters));
+            retired += counters;
+        }
+    };
+
+    double perCall(const uint64_t& ns, const uint64_t& calls) {
+        return calls ? double(ns) / calls : 0;
+    }
+}
+
+Stats::Counters& Stats::Counters::operator+=(const Counters& o) {
+    for (int i = 0; i < COUNTER_COUNT; ++i)
+        counts[i] += o.counts[i];
+    for (int i = 0; i < PHASE_COUNT; ++i)
+        ns[i] += o.ns[i];
+    return *this;
+}
+
+Stats::Counters& Stats::local() {
+    thread_local Registration registration;
+    return registration.counters;
+}
+
+Stats::Counters Stats::collect() {
+    std::lock_guard<std::mutex> lock(mutex);
+    Counters total = retired;
+    retired = Counters();
+    for (Counters* counters : threads) {
+        total += *counters;
+        *counters = Counters();
+    }
+    return total;
+}
+
+void Stats::report(const int& round, const long long& expanded, const int& depth) {
+    Counters c = collect();
+    char line[Log::SLOT_SIZE];
+    int length = std::snprintf(line, sizeof(line), "stats %d: expanded %lld depth %d | "
+        "neighbors %llu calls %llu states %.0f ns/call | select %llu %.0f ns/call | legality %llu | parse %llu ns\n",
+        round, expanded, depth,
+        (unsigned long long)c.counts[NEIGHBOR_CALLS], (unsigned long long)c.counts[NEIGHBORS],
+        perCall(c.ns[EXPAND], c.counts[NEIGHBOR_CALLS]),
+        (unsigned long long)c.counts[SELECTIONS], perCall(c.ns[SELECT], c.counts[SELECTIONS]),
+        (unsigned long long)c.counts[LEGALITY_CHECKS], (unsigned long long)c.ns[PARSE]);
+    Log::append(line, std::min(size_t(length), sizeof(line) - 1));
+}
+
+#endif
+
+// TranspositionTable.cpp
+
+#include <algorithm>
+
+void TranspositionTable::reserve(const int& size) {
+    int capacityLog = 4;
+    while ((size_t(1) << capacityLog) < 2 * size_t(size))
+        ++capacityLog;
+    if ((size_t(1) << capacityLog) <= entries.size())
+        return;
+
+    entries.assign(size_t(1) << capacityLog, Entry{0, 0, 0});
+    mask = (uint64_t(1) << capacityLog) - 1;
+    shift = 64 - capacityLog;
+    generation = 1;
+}
+
+void TranspositionTable::clear() {
+    if (++generation == 0) {
+        std::fill(entries.begin(), entries.end(), Entry{0, 0, 0});
+        generation = 1;
+    }
+}
+
+// WorkerPool.cpp
+
+#include <cassert>
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+void WorkerPool::resize(const int& workerCount) {
+    assert(workerCount >= 1);
+    if (workerCount == size())
+        return;
+
+    stop();
+    stopping = false;
+    for (int worker = 1; worker < workerCount; ++worker)
+        threads.emplace_back(&WorkerPool::work, this, worker, round);
+}
+
+int WorkerPool::size() const {
+    return int(threads.size()) + 1;
+}
+
+void WorkerPool::run(const std::function<void(int)>& job) {
+    if (!threads.empty()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->job = &job;
+        pending = int(threads.size());
+        ++round;
+    }
+    wake.notify_all();
+
+    job(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return pending == 0; });
+}
+
+void WorkerPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto& thread : threads)
+        thread.join();
+    threads.clear();
+}
+
+void WorkerPool::work(const int& worker, uint64_t seen) {
+    while (true) {
+        const std::function<void(int)>* task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || round != seen; });
+            if (stopping)
+                return;
+            seen = round;
+            task = job;
+        }
+
+        (*task)(worker);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0)
+            done.notify_one();
+    }
+}
+
+// main.cpp
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// The agent: answers every frame the referee writes on stdin with the
+// engine's decision on stdout.
+int main(int argc, char* argv[]) {
 	std::ios_base::sync_with_stdio(false);
-	
-    Battle::start();
 
-    return 0;
+	static SearchEngine engine;
+	Options::loadEnvironment();
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!std::strcmp(argv[i], "-T"))
+			engine.firstTurnTimeLimit = std::atof(argv[i + 1]);
+		else if (!std::strcmp(argv[i], "-t"))
+			engine.turnTimeLimit = std::atof(argv[i + 1]);
+		else if (!std::strcmp(argv[i], "-e"))
+			engine.engine = std::strcmp(argv[i + 1], "mcts") ?
+				SearchEngine::Engine::BEAM : SearchEngine::Engine::MCTS;
+		else if (!std::strcmp(argv[i], "-p"))
+			Options::loadFile(argv[i + 1]);
+		// workers expanding each layer, one by default
+		else if (!std::strcmp(argv[i], "-j"))
+			engine.threadCount = std::max(1, std::atoi(argv[i + 1]));
+	}
+	Options::update();
+	engine.setParams(Options::params);
+
+	static Reader input(0);
+	Snapshot snapshot;
+	while (!input.eof()) {
+		// eof() waits for the turn's first byte
+		auto received = Timer::Clock::now();
+		snapshot.read(input);
+		Decision decision = engine.decide(snapshot, received);
+		decision.action->print(std::cout);
+		engine.report(decision);
+		Log::flush();
+	}
+
+	return 0;
 }
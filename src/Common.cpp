@@ -1,11 +1,24 @@
 #include "Common.hpp"
 
 Timer::Timer(float timeLimit) :
-	timeLimit(timeLimit), startTime(std::chrono::high_resolution_clock::now()) {
+	timeLimit(timeLimit), startTime(Clock::now()) {
+
+}
+
+Timer::Timer(float timeLimit, const Clock::time_point& startTime) :
+	timeLimit(timeLimit), startTime(startTime) {
 
 }
 
 bool Timer::isTimeLeft() const {
-	auto now = std::chrono::high_resolution_clock::now();
-	return std::chrono::duration<float>(now - startTime).count() * 1000 < timeLimit;
+	return elapsed() < timeLimit;
+}
+
+float Timer::elapsed() const {
+	auto now = Clock::now();
+	return std::chrono::duration<float>(now - startTime).count() * 1000;
+}
+
+float Timer::limit() const {
+	return timeLimit;
 }
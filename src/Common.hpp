@@ -16,62 +16,32 @@ constexpr int INF = 1e9;
 #define DEBUG
 #endif
 
-#ifdef DEBUG
-
-inline void __debug(const char* s, const char*) {
-    std::cerr << s << ": ";
-}
-
-template<typename T>
-void __debug(const char* s, const T& x) {
-    std::cerr << s << ": " << x << " ";
-}
-
-template<typename T, typename... Args>
-void __debug(const char* s, const T& x, const Args&... rest) {
-    int bracket = 0;
-    char c;
-    while ((c = *s) != ',' || bracket)
-    {
-        std::cerr << *s++;
-        switch (c)
-        {
-            case '(':
-            case '{':
-            case '[':
-                ++bracket;
-                break;
-            case ')':
-            case '}':
-            case ']':
-                --bracket;
-        }
-    }
-    std::cerr << ": ";
-    std::cerr << x << ",";
-    __debug(s + 1, rest...);
-
-}
-
-template<typename... Args>
-void _debug(const char* s, const Args&... rest) {
-    __debug(s, rest...);
-    std::cerr << std::endl;
-}
-
-#define debug(...) _debug(#__VA_ARGS__, __VA_ARGS__)
+#include "Log.hpp"
+
+// Builds a hot function once for AVX-512 and once for AVX2 hosts on top of
+// the baseline the Makefile targets (SSE4.2), and lets the loader pick
+// the best the CPU runs, so one binary is at full speed on every host.
+// Only for functions called from the file that defines them.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define MULTIVERSION __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
 #else
-#define debug(...) 13
+#define MULTIVERSION
 #endif
 
 class Timer {
 public:
+    using Clock = std::chrono::steady_clock;
+
     Timer(float timeLimit);
+    // Counts from startTime instead of from now.
+    Timer(float timeLimit, const Clock::time_point& startTime);
     bool isTimeLeft() const;
+    float elapsed() const;
+    float limit() const;
 
 private:
     float timeLimit;
-    std::chrono::time_point<std::chrono::high_resolution_clock> startTime;
+    Clock::time_point startTime;
 };
 
 #endif /* COMMON_HPP */
@@ -2,45 +2,20 @@
 
 #include <cassert>
 
-int& Delta::operator[](const int& idx) {
-    return delta[idx];
-}
-
-const int& Delta::operator[](const int& idx) const {
-    return delta[idx];
-}
+Delta::Delta(const int& d0, const int& d1, const int& d2, const int& d3) :
+    packed(uint8_t(d0) | uint8_t(d1) << 8 | uint8_t(d2) << 16 | uint32_t(uint8_t(d3)) << 24) {
 
-Delta& Delta::operator+=(const Delta& o) {
-    for (int i = 0; i < 4; ++i)
-        delta[i] += o[i];
-    return *this;
-}
-
-bool Delta::canApply(const Delta& d) const {
-    int s = 0;
-    for (int i = 0; i < 4; ++i) {
-        int diff = delta[i] + d[i];
-        if (diff < 0)
-            return false;
-        s += diff;
-    }
-    assert(s >= 0);
-    return s <= 10; 
+    assert((*this)[0] == d0 && (*this)[1] == d1 && (*this)[2] == d2 && (*this)[3] == d3);
 }
 
 std::istream& operator>>(std::istream& in, Delta& d) {
-    return in >> d.delta[0] >> d.delta[1]
-              >> d.delta[2] >> d.delta[3];
+    int d0, d1, d2, d3;
+    in >> d0 >> d1 >> d2 >> d3;
+    d = Delta(d0, d1, d2, d3);
+    return in;
 }
 
 std::ostream& operator<<(std::ostream& out, const Delta& o) {
-    return out << "{" << o.delta[0] << "," << o.delta[1] << ","
-               << o.delta[2] << "," << o.delta[3] << "}";
-}
-
-Delta operator+(const Delta& d1, const Delta& d2) {
-    Delta res;
-    for (int i = 0; i < 4; ++i)
-        res[i] = d1[i] + d2[i];
-    return res;
+    return out << "{" << o[0] << "," << o[1] << ","
+               << o[2] << "," << o[3] << "}";
 }
@@ -2,31 +2,83 @@
 #define DELTA_HPP
 
 #include "Common.hpp"
+#include "Stats.hpp"
 
 #include <iostream>
+#include <cstdint>
 
-using delta_t = int;
-
+// Four ingredient counts packed into 8-bit two's complement lanes of one
+// word. The top bit of every lane is a guard bit: additions are done on
+// the low 7 bits only, so carries never cross into the neighbouring lane,
+// and a set guard bit after an addition means that lane went negative.
 struct Delta {
-    delta_t delta[4] = {0};
+    uint32_t packed = 0;
+
+    static constexpr uint32_t LANE_LOW = 0x7f7f7f7fu;
+    static constexpr uint32_t LANE_GUARD = 0x80808080u;
+    static constexpr uint32_t LANE_ONES = 0x01010101u;
+    static constexpr int MAX_INVENTORY = 10;
+
+    Delta() = default;
+    Delta(const int& d0, const int& d1, const int& d2, const int& d3);
 
-    bool canApply(const Delta& d) const;
+    inline bool canApply(const Delta& d) const;
     inline eval_t eval() const;
+    inline int sum() const;
 
-    int& operator[](const int& idx);
-    const int& operator[](const int& idx) const;
-    Delta& operator+=(const Delta& o);
+    inline int operator[](const int& idx) const;
+    inline Delta& operator+=(const Delta& o);
+    inline bool operator==(const Delta& o) const;
 
     friend std::istream& operator>>(std::istream& in, Delta& d);
     friend std::ostream& operator<<(std::ostream& out, const Delta& o);
-    friend Delta operator+(const Delta& d1, const Delta& d2);
+    friend inline Delta operator+(const Delta& d1, const Delta& d2);
+
+private:
+    static inline uint32_t add(const uint32_t& a, const uint32_t& b);
 };
 
+uint32_t Delta::add(const uint32_t& a, const uint32_t& b) {
+    return ((a & LANE_LOW) + (b & LANE_LOW)) ^ ((a ^ b) & LANE_GUARD);
+}
+
+// Lanes of the result stay within [-10, 20] as long as *this is a legal
+// inventory and d is a spell or order delta, so the byte sum can't wrap.
+bool Delta::canApply(const Delta& d) const {
+    STATS_COUNT(LEGALITY_CHECKS, 1);
+    uint32_t result = add(packed, d.packed);
+    uint32_t total = (result * LANE_ONES) >> 24;
+    return !(result & LANE_GUARD) & (total <= MAX_INVENTORY);
+}
+
 eval_t Delta::eval() const {
     eval_t value = 0;
     for (int i = 0; i < 4; ++i)
-        value += delta[i] * (i + 1);
+        value += (*this)[i] * (i + 1);
     return value;
 }
 
+int Delta::sum() const {
+    return (*this)[0] + (*this)[1] + (*this)[2] + (*this)[3];
+}
+
+int Delta::operator[](const int& idx) const {
+    return int8_t(packed >> (8 * idx));
+}
+
+Delta& Delta::operator+=(const Delta& o) {
+    packed = add(packed, o.packed);
+    return *this;
+}
+
+bool Delta::operator==(const Delta& o) const {
+    return packed == o.packed;
+}
+
+Delta operator+(const Delta& d1, const Delta& d2) {
+    Delta res;
+    res.packed = Delta::add(d1.packed, d2.packed);
+    return res;
+}
+
 #endif /* DELTA_HPP */
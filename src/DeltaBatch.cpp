@@ -0,0 +1,133 @@
+#include "DeltaBatch.hpp"
+
+#include <algorithm>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+void DeltaBatch::assign(const std::vector<Delta>& deltas) {
+    count = int(deltas.size());
+    int padded = (count + WIDTH - 1) / WIDTH * WIDTH;
+    packed.assign(padded, 0);
+    sums.assign(padded, Delta::MAX_INVENTORY + 1);
+    for (int k = 0; k < count; ++k) {
+        packed[k] = deltas[k].packed;
+        sums[k] = deltas[k].sum();
+    }
+}
+
+int DeltaBatch::size() const {
+    return count;
+}
+
+int DeltaBatch::maskWords() const {
+    return (count + 63) / 64;
+}
+
+const char* DeltaBatch::kernel() {
+    return variant().name;
+}
+
+const DeltaBatch::Variant& DeltaBatch::variant() {
+    static const Variant chosen = pick();
+    return chosen;
+}
+
+DeltaBatch::Variant DeltaBatch::pick() {
+#ifdef __x86_64__
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return { "AVX-512", applicableAvx512 };
+    if (__builtin_cpu_supports("avx2"))
+        return { "AVX2", applicableAvx2 };
+    if (__builtin_cpu_supports("sse4.2"))
+        return { "SSE4.2", applicableSse42 };
+#endif
+    return { "scalar", applicableScalar };
+}
+
+// In every kernel lanes of inv + delta stay within [-10, 20], so byte
+// additions can't wrap and a negative lane is one with its sign bit set.
+// Each mask word is built in a register from the steps it covers and
+// stored once.
+
+#ifdef __x86_64__
+__attribute__((target("avx512f,avx512bw")))
+void DeltaBatch::applicableAvx512(const DeltaBatch& batch, const Delta& inv, uint64_t* masks) {
+    STATS_COUNT(LEGALITY_CHECKS, batch.count);
+    const __m512i inventory = _mm512_set1_epi32(int(inv.packed));
+    const __m512i room = _mm512_set1_epi32(Delta::MAX_INVENTORY - inv.sum());
+    const __m512i signs = _mm512_set1_epi32(int(Delta::LANE_GUARD));
+    const int padded = int(batch.packed.size());
+    for (int word = 0; 64 * word < padded; ++word) {
+        uint64_t mask = 0;
+        for (int k = 64 * word; k < std::min(padded, 64 * (word + 1)); k += 16) {
+            __m512i deltas = _mm512_loadu_si512(batch.packed.data() + k);
+            __m512i deltaSums = _mm512_loadu_si512(batch.sums.data() + k);
+            __mmask16 negative = _mm512_test_epi32_mask(_mm512_add_epi8(inventory, deltas), signs);
+            __mmask16 full = _mm512_cmpgt_epi32_mask(deltaSums, room);
+            mask |= uint64_t(uint16_t(~(negative | full))) << (k % 64);
+        }
+        masks[word] = mask;
+    }
+}
+
+__attribute__((target("avx2")))
+void DeltaBatch::applicableAvx2(const DeltaBatch& batch, const Delta& inv, uint64_t* masks) {
+    STATS_COUNT(LEGALITY_CHECKS, batch.count);
+    const __m256i inventory = _mm256_set1_epi32(int(inv.packed));
+    const __m256i room = _mm256_set1_epi32(Delta::MAX_INVENTORY - inv.sum());
+    const __m256i zero = _mm256_setzero_si256();
+    const int padded = int(batch.packed.size());
+    for (int word = 0; 64 * word < padded; ++word) {
+        uint64_t mask = 0;
+        for (int k = 64 * word; k < std::min(padded, 64 * (word + 1)); k += 8) {
+            __m256i deltas = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(batch.packed.data() + k));
+            __m256i deltaSums = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(batch.sums.data() + k));
+            __m256i negativeLanes = _mm256_cmpgt_epi8(zero, _mm256_add_epi8(inventory, deltas));
+            __m256i nonNegative = _mm256_cmpeq_epi32(negativeLanes, zero);
+            __m256i legal = _mm256_andnot_si256(_mm256_cmpgt_epi32(deltaSums, room), nonNegative);
+            mask |= uint64_t(uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(legal)))) << (k % 64);
+        }
+        masks[word] = mask;
+    }
+}
+
+__attribute__((target("sse4.2")))
+void DeltaBatch::applicableSse42(const DeltaBatch& batch, const Delta& inv, uint64_t* masks) {
+    STATS_COUNT(LEGALITY_CHECKS, batch.count);
+    const __m128i inventory = _mm_set1_epi32(int(inv.packed));
+    const __m128i room = _mm_set1_epi32(Delta::MAX_INVENTORY - inv.sum());
+    const __m128i zero = _mm_setzero_si128();
+    const int padded = int(batch.packed.size());
+    for (int word = 0; 64 * word < padded; ++word) {
+        uint64_t mask = 0;
+        for (int k = 64 * word; k < std::min(padded, 64 * (word + 1)); k += 4) {
+            __m128i deltas = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(batch.packed.data() + k));
+            __m128i deltaSums = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(batch.sums.data() + k));
+            __m128i negativeLanes = _mm_cmpgt_epi8(zero, _mm_add_epi8(inventory, deltas));
+            __m128i nonNegative = _mm_cmpeq_epi32(negativeLanes, zero);
+            __m128i legal = _mm_andnot_si128(_mm_cmpgt_epi32(deltaSums, room), nonNegative);
+            mask |= uint64_t(uint32_t(_mm_movemask_ps(_mm_castsi128_ps(legal)))) << (k % 64);
+        }
+        masks[word] = mask;
+    }
+}
+#endif
+
+void DeltaBatch::applicableScalar(const DeltaBatch& batch, const Delta& inv, uint64_t* masks) {
+    for (int word = 0; 64 * word < batch.count; ++word) {
+        uint64_t mask = 0;
+        for (int k = 64 * word; k < std::min(batch.count, 64 * (word + 1)); ++k) {
+            Delta delta;
+            delta.packed = batch.packed[k];
+            mask |= uint64_t(inv.canApply(delta)) << (k % 64);
+        }
+        masks[word] = mask;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef DELTA_BATCH_HPP
+#define DELTA_BATCH_HPP
+
+#include "Delta.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Deltas laid out to be tested against one inventory all at once. Which
+// of them can be applied comes back as a bitmask, delta k in bit k % 64
+// of word k / 64. The test runs 16, 8 or 4 deltas a step with AVX-512,
+// AVX2 or SSE4.2, whichever the CPU has, picked once at startup, and
+// falls back to Delta::canApply() one by one without any of them.
+class DeltaBatch {
+public:
+    static constexpr int WIDTH = 16;
+
+    void assign(const std::vector<Delta>& deltas);
+    int size() const;
+    int maskWords() const;
+
+    void applicable(const Delta& inv, uint64_t* masks) const {
+        variant().run(*this, inv, masks);
+    }
+
+    static const char* kernel();
+
+private:
+    using Kernel = void (*)(const DeltaBatch&, const Delta&, uint64_t*);
+
+    struct Variant {
+        const char* name;
+        Kernel run;
+    };
+
+    static const Variant& variant();
+    static Variant pick();
+
+    static void applicableAvx512(const DeltaBatch& batch, const Delta& inv, uint64_t* masks);
+    static void applicableAvx2(const DeltaBatch& batch, const Delta& inv, uint64_t* masks);
+    static void applicableSse42(const DeltaBatch& batch, const Delta& inv, uint64_t* masks);
+    static void applicableScalar(const DeltaBatch& batch, const Delta& inv, uint64_t* masks);
+
+    // padded to a multiple of WIDTH with deltas no inventory can take
+    std::vector<uint32_t> packed;
+    std::vector<int32_t> sums;
+    int count = 0;
+};
+
+#endif /* DELTA_BATCH_HPP */
@@ -0,0 +1,23 @@
+#include "Inventory.hpp"
+
+#include <cassert>
+
+const Inventory::Tables Inventory::tables;
+
+Inventory::Tables::Tables() {
+    indices.fill(NONE);
+
+    int count = 0;
+    for (int a = 0; a <= Delta::MAX_INVENTORY; ++a)
+        for (int b = 0; a + b <= Delta::MAX_INVENTORY; ++b)
+            for (int c = 0; a + b + c <= Delta::MAX_INVENTORY; ++c)
+                for (int d = 0; a + b + c + d <= Delta::MAX_INVENTORY; ++d) {
+                    Delta inv(a, b, c, d);
+                    deltas[count] = inv;
+                    evals[count] = inv.eval();
+                    indices[code(inv)] = count;
+                    ++count;
+                }
+
+    assert(count == COUNT);
+}
@@ -0,0 +1,55 @@
+#ifndef INVENTORY_HPP
+#define INVENTORY_HPP
+
+#include "Delta.hpp"
+
+#include <array>
+#include <cstdint>
+
+using inv_t = int16_t;
+
+// Numbers the C(14, 4) = 1001 inventories with four non-negative counts
+// summing to at most 10, so per-turn tables can be indexed by them.
+class Inventory {
+public:
+    static constexpr int COUNT = 1001;
+    static constexpr inv_t NONE = -1;
+
+    static inline inv_t index(const Delta& inv);
+    static inline const Delta& delta(const inv_t& index);
+    static inline eval_t eval(const inv_t& index);
+
+private:
+    static constexpr int BASE = Delta::MAX_INVENTORY + 1;
+    static constexpr int CODE_COUNT = BASE * BASE * BASE * BASE;
+
+    static inline int code(const Delta& inv);
+
+    struct Tables {
+        Tables();
+
+        std::array<Delta, COUNT> deltas;
+        std::array<eval_t, COUNT> evals;
+        std::array<inv_t, CODE_COUNT> indices;
+    };
+
+    static const Tables tables;
+};
+
+int Inventory::code(const Delta& inv) {
+    return ((inv[0] * BASE + inv[1]) * BASE + inv[2]) * BASE + inv[3];
+}
+
+inv_t Inventory::index(const Delta& inv) {
+    return tables.indices[code(inv)];
+}
+
+const Delta& Inventory::delta(const inv_t& index) {
+    return tables.deltas[index];
+}
+
+eval_t Inventory::eval(const inv_t& index) {
+    return tables.evals[index];
+}
+
+#endif /* INVENTORY_HPP */
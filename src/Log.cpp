@@ -0,0 +1,147 @@
+#include "Log.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <streambuf>
+#include <string>
+
+namespace {
+    struct Slot {
+        std::atomic<size_t> sequence;
+        size_t length;
+        char text[Log::SLOT_SIZE];
+    };
+
+    // A bounded multi-producer queue after Vyukov: the writer holding
+    // ticket t owns slot t % SLOT_COUNT once its sequence is t, and the
+    // message is readable once the sequence is t + 1. Only flush() reads,
+    // under its own mutex, and hands the slot back for ticket
+    // t + SLOT_COUNT.
+    class Ring {
+    public:
+        Ring() {
+            for (size_t i = 0; i < Log::SLOT_COUNT; ++i)
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        ~Ring() {
+            drain();
+        }
+
+        void push(const char* text, const size_t& length) {
+            size_t ticket = head.load(std::memory_order_relaxed);
+            Slot* slot;
+            while (true) {
+                slot = &slots[ticket % Log::SLOT_COUNT];
+                size_t sequence = slot->sequence.load(std::memory_order_acquire);
+                intptr_t lag = intptr_t(sequence) - intptr_t(ticket);
+                if (lag == 0) {
+                    if (head.compare_exchange_weak(ticket, ticket + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (lag < 0) {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                else
+                    ticket = head.load(std::memory_order_relaxed);
+            }
+
+            slot->length = std::min(length, size_t(Log::SLOT_SIZE));
+            std::memcpy(slot->text, text, slot->length);
+            slot->sequence.store(ticket + 1, std::memory_order_release);
+        }
+
+        void drain() {
+            std::lock_guard<std::mutex> lock(reading);
+            pending.clear();
+            while (true) {
+                Slot& slot = slots[tail % Log::SLOT_COUNT];
+                if (slot.sequence.load(std::memory_order_acquire) != tail + 1)
+                    break;
+                pending.append(slot.text, slot.length);
+                slot.sequence.store(tail + Log::SLOT_COUNT, std::memory_order_release);
+                ++tail;
+            }
+
+            size_t lost = dropped.exchange(0, std::memory_order_relaxed);
+            if (lost)
+                pending += "log: " + std::to_string(lost) + " messages dropped\n";
+            if (!pending.empty()) {
+                std::fwrite(pending.data(), 1, pending.size(), stderr);
+                std::fflush(stderr);
+            }
+        }
+
+    private:
+        Slot slots[Log::SLOT_COUNT];
+        alignas(64) std::atomic<size_t> head { 0 };
+        alignas(64) std::atomic<size_t> dropped { 0 };
+        std::mutex reading;
+        size_t tail = 0;
+        std::string pending;
+    };
+
+    Ring ring;
+
+    // Formats into a fixed array; what doesn't fit is cut off.
+    class SlotBuffer : public std::streambuf {
+    public:
+        SlotBuffer() {
+            reset();
+        }
+
+        void reset() {
+            setp(text, text + Log::SLOT_SIZE);
+        }
+
+        char* data() {
+            return pbase();
+        }
+
+        size_t size() const {
+            return pptr() - pbase();
+        }
+
+    private:
+        char text[Log::SLOT_SIZE];
+    };
+
+    struct Formatter {
+        SlotBuffer buffer;
+        std::ostream out { &buffer };
+    };
+
+    Formatter& formatter() {
+        thread_local Formatter f;
+        return f;
+    }
+}
+
+void Log::append(const char* text, const size_t& length) {
+    ring.push(text, length);
+}
+
+void Log::flush() {
+    ring.drain();
+}
+
+std::ostream& Log::begin() {
+    Formatter& f = formatter();
+    f.buffer.reset();
+    f.out.clear();
+    return f.out;
+}
+
+void Log::end() {
+    Formatter& f = formatter();
+    size_t size = f.buffer.size();
+    // a message cut short still ends its line
+    if (size == SLOT_SIZE)
+        f.buffer.data()[size - 1] = '\n';
+    append(f.buffer.data(), size);
+}
@@ -0,0 +1,108 @@
+#ifndef LOG_HPP
+#define LOG_HPP
+
+#include <cstddef>
+#include <ostream>
+
+// Diagnostics that stay out of the turn budget. A call formats its
+// message into a fixed slot of a lock-free ring and returns; nothing is
+// written until flush(), which the agent calls once the action is out.
+// A message that finds the ring full is dropped and counted, so logging
+// never blocks or allocates inside a search.
+//
+// Levels are picked at compile time with LOG_LEVEL. Calls above it
+// expand to nothing, arguments included. It defaults to LOG_DEBUG in
+// DEBUG builds, the submitted merge included, and to LOG_OFF otherwise.
+#define LOG_OFF 0
+#define LOG_ERROR 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3
+
+#ifndef LOG_LEVEL
+#ifdef DEBUG
+#define LOG_LEVEL LOG_DEBUG
+#else
+#define LOG_LEVEL LOG_OFF
+#endif
+#endif
+
+namespace Log {
+    constexpr int SLOT_COUNT = 256;
+    constexpr int SLOT_SIZE = 2048;
+
+    // Copies text into the ring as one message, cut to SLOT_SIZE.
+    void append(const char* text, const size_t& length);
+    // Writes out every message queued so far, in order, to stderr.
+    void flush();
+
+    // The stream messages are formatted into: the calling thread's own,
+    // over a buffer of SLOT_SIZE bytes that is cleared on every call.
+    std::ostream& begin();
+    void end();
+
+    inline void names(std::ostream& out, const char* s, const char*) {
+        out << s << ": ";
+    }
+
+    template<typename T>
+    void names(std::ostream& out, const char* s, const T& x) {
+        out << s << ": " << x << " ";
+    }
+
+    // Prints every argument after its own expression, splitting the
+    // stringified argument list on the commas outside brackets.
+    template<typename T, typename... Args>
+    void names(std::ostream& out, const char* s, const T& x, const Args&... rest) {
+        int bracket = 0;
+        char c;
+        while ((c = *s) != ',' || bracket)
+        {
+            out << *s++;
+            switch (c)
+            {
+                case '(':
+                case '{':
+                case '[':
+                    ++bracket;
+                    break;
+                case ')':
+                case '}':
+                case ']':
+                    --bracket;
+            }
+        }
+        out << ": ";
+        out << x << ",";
+        names(out, s + 1, rest...);
+    }
+
+    template<typename... Args>
+    void write(const char* s, const Args&... rest) {
+        std::ostream& out = begin();
+        names(out, s, rest...);
+        out << '\n';
+        end();
+    }
+}
+
+#define LOG_WRITE(...) Log::write(#__VA_ARGS__, __VA_ARGS__)
+
+#if LOG_LEVEL >= LOG_ERROR
+#define logError(...) LOG_WRITE(__VA_ARGS__)
+#else
+#define logError(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_INFO
+#define logInfo(...) LOG_WRITE(__VA_ARGS__)
+#else
+#define logInfo(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_DEBUG
+#define debug(...) LOG_WRITE(__VA_ARGS__)
+#else
+#define debug(...) ((void)0)
+#endif
+
+#endif /* LOG_HPP */
@@ -0,0 +1,218 @@
+#include "Mcts.hpp"
+#include "Stats.hpp"
+
+#include <cassert>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void MctsStats::reset() {
+    iterations = 0;
+    nodes = depth = reused = 0;
+    time = overshoot = 0;
+    firstAction = SearchEngine::NO_ACTION;
+}
+
+Mcts::Mcts(SearchEngine& engine) :
+    engine(engine) {
+
+}
+
+void Mcts::forget() {
+    played = -1;
+}
+
+const Action* Mcts::search(float timeLimit, long long maxIterations) {
+    return search(Timer(timeLimit), maxIterations);
+}
+
+const Action* Mcts::search(const Timer& timer, long long maxIterations) {
+    reserveArena();
+    State initialState = engine.getInitialState();
+    stats.reset();
+    if (reuseTree(initialState))
+        stats.reused = nodes[root].visits;
+    else {
+        root = 0;
+        nodeCount = 1;
+        nodes[root] = { 0, 0, 0, 0, 0 };
+        states[root] = initialState;
+        minReward = maxReward = initialState.leafEvaluation(engine);
+    }
+
+    // The root is always expanded and every child played out once, so
+    // there is an answer however short the budget.
+    if (nodes[root].childCount == 0)
+        expand(root);
+    long long iterations = 0;
+    while (iterations < maxIterations &&
+        (iterations < nodes[root].childCount || iterations % TIME_CHECK_INTERVAL ||
+            timer.isTimeLeft())) {
+
+        path.assign(1, root);
+        int node = root;
+        while (nodes[node].childCount > 0) {
+            node = selectChild(node);
+            path.push_back(node);
+            if (nodes[node].visits == 0)
+                break;
+        }
+        if (nodes[node].visits > 0 && expand(node)) {
+            node = nodes[node].firstChild;
+            path.push_back(node);
+        }
+
+        backpropagate(rollout(states[node]));
+        stats.depth = std::max(stats.depth, int(path.size()) - 1);
+        ++iterations;
+    }
+
+    const Node& r = nodes[root];
+    assert(r.childCount > 0);
+    int best = r.firstChild;
+    for (int i = r.firstChild; i < r.firstChild + r.childCount; ++i)
+        if (nodes[i].visits > nodes[best].visits ||
+            (nodes[i].visits == nodes[best].visits &&
+                nodes[i].value * nodes[best].visits > nodes[best].value * nodes[i].visits))
+            best = i;
+
+    stats.iterations = iterations;
+    stats.nodes = nodeCount;
+    stats.time = timer.elapsed();
+    stats.overshoot = stats.time - timer.limit();
+    stats.firstAction = states[best].secondAction;
+
+    played = best;
+    playedSignature = engine.tableSignature();
+    assert(states[best].secondAction < SearchEngine::UNKNOWN_ACTION);
+    return engine.actions[states[best].secondAction];
+}
+
+// Nodes outside the kept subtree are only reclaimed by starting over,
+// which happens once they fill half the arena.
+bool Mcts::reuseTree(const State& initialState) {
+    bool reusable = engine.reuseSearch && played != -1 &&
+        playedSignature == engine.tableSignature() &&
+        states[played].key() == initialState.key() &&
+        nodeCount <= MAX_NODES / 2;
+    if (reusable) {
+        root = played;
+        reroot();
+    }
+    played = -1;
+    return reusable;
+}
+
+// Re-expresses the kept subtree as searched from its root, like the beam's
+// carried states, so its rewards compare with this turn's. Each node
+// keeps the part of its rewards gamma weighed apart, so their sums rebase
+// as evaluations do. Only the rebased means bound the range of rewards
+// until new ones come in.
+void Mcts::reroot() {
+    const State next = states[root];
+    eval_t nextRootEvaluation = engine.rootEvaluation(next);
+    eval_t shift = nextRootEvaluation - (next.evaluation - next.discounted);
+    float decay = engine.params.decay;
+
+    minReward = std::numeric_limits<eval_t>::max();
+    maxReward = std::numeric_limits<eval_t>::lowest();
+    path.assign(1, root);
+    while (!path.empty()) {
+        int node = path.back();
+        path.pop_back();
+        engine.reroot(states[node], next, nextRootEvaluation);
+
+        Node& n = nodes[node];
+        eval_t undiscounted = n.value - n.discounted;
+        n.discounted = (n.discounted - n.visits * next.discounted) / decay;
+        n.value = undiscounted + n.visits * shift + n.discounted;
+        if (n.visits > 0) {
+            minReward = std::min(minReward, n.value / n.visits);
+            maxReward = std::max(maxReward, n.value / n.visits);
+        }
+
+        for (int i = n.firstChild; i < n.firstChild + n.childCount; ++i)
+            path.push_back(i);
+    }
+}
+
+void Mcts::reserveArena() {
+    if (int(nodes.size()) < MAX_NODES) {
+        nodes.resize(MAX_NODES);
+        states.resize(MAX_NODES);
+    }
+    if (int(playout.size()) < engine.maxNeighbors)
+        playout.resize(engine.maxNeighbors);
+}
+
+// UCB1 with values scaled to [0, 1] by the range of rewards seen so far,
+// since evaluations aren't bounded. Unvisited children go first.
+int Mcts::selectChild(const int& parent) {
+    STATS_TIME(SELECT);
+    STATS_COUNT(SELECTIONS, 1);
+    const Node& p = nodes[parent];
+    eval_t range = maxReward - minReward;
+    float logVisits = std::log(float(p.visits));
+    float exploration = engine.params.exploration;
+
+    int best = -1;
+    float bestScore = -1;
+    for (int i = p.firstChild; i < p.firstChild + p.childCount; ++i) {
+        const Node& child = nodes[i];
+        if (child.visits == 0)
+            return i;
+        float mean = child.value / child.visits;
+        float exploitation = range > 0 ? (mean - minReward) / range : 0.5f;
+        float score = exploitation + exploration * std::sqrt(logVisits / child.visits);
+        if (score > bestScore) {
+            bestScore = score;
+            best = i;
+        }
+    }
+
+    assert(best != -1);
+    return best;
+}
+
+// Generates the children of node straight into the arena. Returns false,
+// leaving node a leaf, once the arena can't fit another expansion or node
+// is as deep as the game goes.
+bool Mcts::expand(const int& node) {
+    if (nodeCount + engine.maxNeighbors > MAX_NODES ||
+        states[node].depth >= engine.roundsLeft())
+        return false;
+
+    State parent = states[node];
+    parent.firstAction = SearchEngine::TREE_ACTION;
+    parent.secondAction = SearchEngine::NO_ACTION;
+    int childCount = parent.getNeighbors(engine, states.data() + nodeCount);
+    assert(childCount > 0 && childCount <= engine.maxNeighbors);
+    nodes[node].firstChild = nodeCount;
+    nodes[node].childCount = childCount;
+    for (int i = nodeCount; i < nodeCount + childCount; ++i)
+        nodes[i] = { 0, 0, 0, 0, 0 };
+    nodeCount += childCount;
+    return true;
+}
+
+State Mcts::rollout(const State& state) {
+    State current = state;
+    int maxDepth = engine.roundsLeft();
+    for (int d = 0; d < ROLLOUT_DEPTH && current.depth < maxDepth; ++d) {
+        int childCount = current.getNeighbors(engine, playout.data());
+        current = playout[random() % childCount];
+    }
+    return current;
+}
+
+void Mcts::backpropagate(const State& leaf) {
+    eval_t reward = leaf.leafEvaluation(engine);
+    eval_t discounted = reward - (leaf.evaluation - leaf.discounted);
+    minReward = std::min(minReward, reward);
+    maxReward = std::max(maxReward, reward);
+    for (const int& node : path) {
+        ++nodes[node].visits;
+        nodes[node].value += reward;
+        nodes[node].discounted += discounted;
+    }
+}
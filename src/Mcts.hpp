@@ -0,0 +1,79 @@
+#ifndef MCTS_HPP
+#define MCTS_HPP
+
+#include "SearchEngine.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// UCT over the same move generator as the beam search. Nodes live in an
+// arena allocated on the first search, children of a node next to each
+// other, and leaves are valued by leafEvaluation() at the end of a short
+// random playout. The secondAction of a node is the move leading into it,
+// under a firstAction of SearchEngine::TREE_ACTION.
+// When this turn's root is the child played last turn, under the same
+// tables, its subtree is kept, rebased onto the new root, and the search
+// carries on from there.
+class Mcts {
+    friend class Bench;
+
+public:
+    explicit Mcts(SearchEngine& engine);
+    Mcts(const Mcts&) = delete;
+    Mcts& operator=(const Mcts&) = delete;
+
+    const Action* search(float timeLimit, long long maxIterations = INF);
+    const Action* search(const Timer& timer, long long maxIterations = INF);
+    // Drops the tree kept for the next search.
+    void forget();
+
+    static constexpr int MAX_NODES = 1 << 19;
+    static constexpr int ROLLOUT_DEPTH = 8;
+    static constexpr int TIME_CHECK_INTERVAL = 16;
+
+    MctsStats stats;
+
+private:
+    struct Node {
+        int firstChild;
+        int childCount;
+        int visits;
+        eval_t value;
+        // the part of value gamma weighed, orders and recipes
+        eval_t discounted;
+    };
+
+    void reserveArena();
+    bool reuseTree(const State& initialState);
+    void reroot();
+    int selectChild(const int& parent);
+    bool expand(const int& node);
+    State rollout(const State& state);
+    void backpropagate(const State& leaf);
+    inline uint32_t random();
+
+    SearchEngine& engine;
+
+    // states[i] is the state of nodes[i]
+    std::vector<Node> nodes;
+    std::vector<State> states;
+    int nodeCount = 0;
+    int root = 0;
+    int played = -1;
+    uint64_t playedSignature = 0;
+
+    std::vector<State> playout;
+    std::vector<int> path;
+    eval_t minReward = 0;
+    eval_t maxReward = 0;
+    uint32_t seed = 2463534242u;
+};
+
+uint32_t Mcts::random() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+#endif /* MCTS_HPP */
@@ -1,3 +1,115 @@
 #include "Options.hpp"
 
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
 int Options::enemyOrdersDone = 0;
+
+Options::Params Options::params = Options::DEFAULTS;
+
+namespace {
+	struct Field {
+		const char* name;
+		float Options::Params::* real;
+		int Options::Params::* integer;
+		// read by the move generators or the leaf evaluation, which
+		// Compiled fixes to DEFAULTS
+		bool compiled;
+	};
+
+	const Field fields[] = {
+		{ "decay", &Options::Params::decay, nullptr, true },
+		{ "learnDecay", &Options::Params::learnDecay, nullptr, true },
+		{ "nearOrderWeight", &Options::Params::nearOrderWeight, nullptr, true },
+		{ "rivalDiscount", &Options::Params::rivalDiscount, nullptr, true },
+		{ "lastOrderBonus", &Options::Params::lastOrderBonus, nullptr, true },
+		{ "castableValue", &Options::Params::castableValue, nullptr, true },
+		{ "exploration", &Options::Params::exploration, nullptr, false },
+		{ "beamWidth", nullptr, &Options::Params::beamWidth, false },
+	};
+
+	// decay -> WITCH_DECAY, learnDecay -> WITCH_LEARN_DECAY
+	std::string environmentName(const char* name) {
+		std::string result = "WITCH_";
+		for (const char* c = name; *c; ++c) {
+			if (std::isupper(*c))
+				result += '_';
+			result += char(std::toupper(*c));
+		}
+		return result;
+	}
+}
+
+bool Options::set(const char* name, const char* value) {
+	for (const auto& field : fields) {
+		if (std::strcmp(field.name, name))
+			continue;
+
+		char* end;
+		if (field.real)
+			params.*field.real = std::strtof(value, &end);
+		else
+			params.*field.integer = int(std::strtol(value, &end, 10));
+		if (end == value || *end) {
+			std::cerr << "options: bad value " << value << " for " << name << "\n";
+			return false;
+		}
+		return true;
+	}
+
+	std::cerr << "options: unknown parameter " << name << "\n";
+	return false;
+}
+
+// Lines of "name value"; anything after # is a comment.
+bool Options::loadFile(const char* path) {
+	std::ifstream file(path);
+	if (!file) {
+		std::cerr << "options: cannot open " << path << "\n";
+		return false;
+	}
+
+	bool ok = true;
+	for (std::string line; std::getline(file, line); ) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream in(line);
+		std::string name, value;
+		if (in >> name >> value)
+			ok &= set(name.c_str(), value.c_str());
+	}
+	return ok;
+}
+
+bool Options::loadEnvironment() {
+	bool ok = true;
+	for (const auto& field : fields)
+		if (const char* value = std::getenv(environmentName(field.name).c_str()))
+			ok &= set(field.name, value);
+	return ok;
+}
+
+void Options::update() {
+	params.derive();
+}
+
+bool Options::isDefault(const Params& p) {
+	for (const auto& field : fields)
+		if (field.compiled && (field.real ? p.*field.real != DEFAULTS.*field.real :
+			p.*field.integer != DEFAULTS.*field.integer))
+			return false;
+	return true;
+}
+
+void Options::print(std::ostream& out) {
+	for (const auto& field : fields) {
+		out << field.name << " ";
+		if (field.real)
+			out << params.*field.real << "\n";
+		else
+			out << params.*field.integer << "\n";
+	}
+}
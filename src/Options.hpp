@@ -1,8 +1,67 @@
 #ifndef OPTIONS_HPP
 #define OPTIONS_HPP
 
+#include <array>
+#include <iostream>
+
+// Search parameters. DEFAULTS are compiled in and the search has a copy
+// specialised for them, with every parameter a constant. A parameter
+// file or WITCH_<NAME> environment variables can override them in params;
+// an engine given parameters that differ from DEFAULTS reads them at run
+// time instead.
 namespace Options {
 	extern int enemyOrdersDone;
+
+	constexpr int MAX_NEAR_ORDER_DISTANCE = 16;
+
+	struct Params {
+		float decay = 0.97f;
+		float learnDecay = 0.6f;
+		float nearOrderWeight = 0.5f;
+		float rivalDiscount = 0.5f;
+		float lastOrderBonus = 1e4f;
+		float castableValue = 0.01f;
+		float exploration = 1.4f;
+		int beamWidth = 2000;
+
+		// nearOrderWeight * decay^(d + 1) for an order d casts away
+		std::array<float, MAX_NEAR_ORDER_DISTANCE + 1> nearOrderDecay{};
+
+		constexpr void derive() {
+			nearOrderDecay[0] = nearOrderWeight * decay;
+			for (int d = 1; d <= MAX_NEAR_ORDER_DISTANCE; ++d)
+				nearOrderDecay[d] = nearOrderDecay[d - 1] * decay;
+		}
+	};
+
+	constexpr Params derived(Params p) {
+		p.derive();
+		return p;
+	}
+
+	constexpr Params DEFAULTS = derived(Params());
+
+	extern Params params;
+
+	// Where the search takes its parameters from, given its own.
+	struct Compiled {
+		static constexpr const Params& get(const Params&) { return DEFAULTS; }
+	};
+	struct Runtime {
+		static const Params& get(const Params& own) { return own; }
+	};
+
+	// Each returns false, naming the problem on stderr, if something
+	// couldn't be used. None of them takes effect before update().
+	bool set(const char* name, const char* value);
+	bool loadFile(const char* path);
+	bool loadEnvironment();
+	void update();
+
+	// Whether Compiled can stand in for p: it may differ from DEFAULTS
+	// only where the search reads its own copy, like beamWidth.
+	bool isDefault(const Params& p);
+	void print(std::ostream& out);
 }
 
 #endif /* OPTIONS_HPP */
@@ -0,0 +1,64 @@
+#include "Reader.hpp"
+
+#include <cerrno>
+#include <unistd.h>
+
+Reader::Reader(const int& fd) :
+    fd(fd), pos(buffer), end(buffer) {
+
+}
+
+Reader::Reader(const char* begin, const char* end) :
+    fd(-1), pos(begin), end(end) {
+
+}
+
+bool Reader::refill() {
+    if (fd < 0)
+        return false;
+
+    ssize_t count;
+    do
+        count = read(fd, buffer, BUFFER_SIZE);
+    while (count < 0 && errno == EINTR);
+
+    if (count <= 0)
+        return false;
+    pos = buffer;
+    end = buffer + count;
+    return true;
+}
+
+void Reader::skipWhitespace() {
+    while (fill() && unsigned(*pos) <= ' ')
+        ++pos;
+}
+
+bool Reader::eof() {
+    skipWhitespace();
+    return pos == end;
+}
+
+int Reader::readInt() {
+    skipWhitespace();
+
+    bool negative = fill() && *pos == '-';
+    if (negative)
+        ++pos;
+
+    int value = 0;
+    while (fill() && unsigned(*pos - '0') < 10)
+        value = value * 10 + (*pos++ - '0');
+    return negative ? -value : value;
+}
+
+char Reader::readKeyword() {
+    skipWhitespace();
+    if (!fill())
+        return '\0';
+
+    char first = *pos;
+    while (fill() && unsigned(*pos) > ' ')
+        ++pos;
+    return first;
+}
@@ -0,0 +1,37 @@
+#ifndef READER_HPP
+#define READER_HPP
+
+// Whitespace separated tokenizer over a file descriptor or a buffer in
+// memory. Reading from a descriptor refills a fixed buffer with whatever
+// read() returns, so it works on an interactive pipe and never allocates.
+class Reader {
+public:
+    explicit Reader(const int& fd);
+    Reader(const char* begin, const char* end);
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    // True once only whitespace is left.
+    bool eof();
+    int readInt();
+    // Skips the next word and returns its first character.
+    char readKeyword();
+
+private:
+    inline bool fill();
+    bool refill();
+    void skipWhitespace();
+
+    static constexpr int BUFFER_SIZE = 1 << 16;
+
+    int fd;
+    const char* pos;
+    const char* end;
+    char buffer[BUFFER_SIZE];
+};
+
+bool Reader::fill() {
+    return pos != end || refill();
+}
+
+#endif /* READER_HPP */
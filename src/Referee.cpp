@@ -0,0 +1,319 @@
+#include "Referee.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+
+namespace {
+    struct DeckEntry {
+        int id;
+        int d0, d1, d2, d3;
+        int price;
+    };
+
+    // Ingredients an order asks for and the rupees it brings.
+    const DeckEntry ORDER_DECK[] = {
+        { 42, 2, 2, 0, 0, 6 }, { 43, 3, 2, 0, 0, 7 }, { 44, 0, 4, 0, 0, 8 },
+        { 45, 2, 0, 2, 0, 8 }, { 46, 2, 3, 0, 0, 8 }, { 47, 3, 0, 2, 0, 9 },
+        { 48, 0, 2, 2, 0, 10 }, { 49, 0, 5, 0, 0, 10 }, { 50, 2, 0, 0, 2, 10 },
+        { 51, 2, 0, 3, 0, 11 }, { 52, 3, 0, 0, 2, 11 }, { 53, 0, 0, 4, 0, 12 },
+        { 54, 0, 2, 0, 2, 12 }, { 55, 0, 3, 2, 0, 12 }, { 56, 0, 2, 3, 0, 13 },
+        { 57, 0, 0, 2, 2, 14 }, { 58, 0, 3, 0, 2, 14 }, { 59, 2, 0, 0, 3, 14 },
+        { 60, 0, 0, 5, 0, 15 }, { 61, 0, 0, 0, 4, 16 }, { 62, 0, 2, 0, 3, 16 },
+        { 63, 0, 0, 3, 2, 17 }, { 64, 0, 0, 2, 3, 18 }, { 65, 0, 0, 0, 5, 20 },
+        { 66, 2, 1, 0, 1, 9 }, { 67, 0, 2, 1, 1, 12 }, { 68, 1, 0, 2, 1, 12 },
+        { 69, 2, 2, 2, 0, 13 }, { 70, 2, 2, 0, 2, 15 }, { 71, 2, 0, 2, 2, 17 },
+        { 72, 0, 2, 2, 2, 19 }, { 73, 1, 1, 1, 1, 12 }, { 74, 3, 1, 1, 1, 14 },
+        { 75, 1, 3, 1, 1, 16 }, { 76, 1, 1, 3, 1, 18 }, { 77, 1, 1, 1, 3, 20 },
+    };
+
+    const DeckEntry RECIPE_DECK[] = {
+        { 0, -3, 0, 0, 1, 0 }, { 1, 3, -1, 0, 0, 0 }, { 2, 1, 1, 0, 0, 0 },
+        { 3, 0, 0, 1, 0, 0 }, { 4, 3, 0, 0, 0, 0 }, { 5, 2, 3, -2, 0, 0 },
+        { 6, 2, 1, -2, 1, 0 }, { 7, 3, 0, 1, -1, 0 }, { 8, 3, -2, 1, 0, 0 },
+        { 9, 2, -3, 2, 0, 0 }, { 10, 2, 2, 0, -1, 0 }, { 11, -4, 0, 2, 0, 0 },
+        { 12, 2, 1, 0, 0, 0 }, { 13, 4, 0, 0, 0, 0 }, { 14, 0, 0, 0, 1, 0 },
+        { 15, 0, 2, 0, 0, 0 }, { 16, 1, 0, 1, 0, 0 }, { 17, -2, 0, 1, 0, 0 },
+        { 18, -1, -1, 0, 1, 0 }, { 19, 0, 2, -1, 0, 0 }, { 20, 2, -2, 0, 1, 0 },
+        { 21, -3, 1, 1, 0, 0 }, { 22, 0, 2, -2, 1, 0 }, { 23, 1, -3, 1, 1, 0 },
+        { 24, 0, 3, 0, -1, 0 }, { 25, 0, -3, 0, 2, 0 }, { 26, 1, 1, 1, -1, 0 },
+        { 27, 1, 2, -1, 0, 0 }, { 28, 4, 1, -1, 0, 0 }, { 29, -5, 0, 0, 2, 0 },
+        { 30, -4, 0, 1, 1, 0 }, { 31, 0, 3, 2, -2, 0 }, { 32, 1, 1, 3, -2, 0 },
+        { 33, -5, 0, 3, 0, 0 }, { 34, -2, 0, -1, 2, 0 }, { 35, 0, 0, -3, 3, 0 },
+        { 36, 0, -3, 3, 0, 0 }, { 37, -3, 3, 0, 0, 0 }, { 38, -2, 2, 0, 0, 0 },
+        { 39, 0, 0, -2, 2, 0 }, { 40, 0, -2, 2, 0, 0 }, { 41, 0, 0, 2, -1, 0 },
+    };
+
+    const Delta STARTING_SPELLS[] = {
+        Delta(2, 0, 0, 0), Delta(-1, 1, 0, 0), Delta(0, -1, 1, 0), Delta(0, 0, -1, 1)
+    };
+    constexpr int FIRST_STARTING_SPELL_ID = 78;
+    const Delta STARTING_INVENTORY(3, 0, 0, 0);
+
+    std::string lanes(const Delta& d) {
+        return std::to_string(d[0]) + " " + std::to_string(d[1]) + " " +
+            std::to_string(d[2]) + " " + std::to_string(d[3]);
+    }
+}
+
+Referee::Referee(const uint32_t& seed) {
+    for (const auto& e : ORDER_DECK)
+        orderDeck.emplace_back(e.id, Delta(-e.d0, -e.d1, -e.d2, -e.d3), e.price);
+    for (const auto& e : RECIPE_DECK) {
+        bool repeatable = e.d0 < 0 || e.d1 < 0 || e.d2 < 0 || e.d3 < 0;
+        recipeDeck.emplace_back(e.id, Delta(e.d0, e.d1, e.d2, e.d3), 0, 0, repeatable);
+    }
+
+    std::mt19937 rng(seed);
+    std::shuffle(orderDeck.begin(), orderDeck.end(), rng);
+    std::shuffle(recipeDeck.begin(), recipeDeck.end(), rng);
+    refill();
+
+    int id = FIRST_STARTING_SPELL_ID;
+    for (auto& player : players) {
+        player.witch.inv = STARTING_INVENTORY;
+        player.witch.score = 0;
+        for (const auto& delta : STARTING_SPELLS)
+            player.spells.emplace_back(id++, delta, true, false);
+    }
+}
+
+std::string Referee::frame(const int& player) const {
+    const Player& me = players[player];
+    const Player& opponent = players[1 - player];
+    std::ostringstream out;
+
+    out << orders.size() + recipes.size() + me.spells.size() + opponent.spells.size() << "\n";
+    for (int i = 0; i < int(orders.size()); ++i)
+        out << orders[i].id << " BREW " << lanes(orders[i].delta) << " "
+            << orders[i].price + bonus(i) << " " << bonus(i) << " " << bonusesLeft(i) << " 0 0\n";
+    for (const auto& r : recipes)
+        out << r.id << " LEARN " << lanes(r.delta) << " 0 " << r.tomeIndex << " " << r.taxCount
+            << " 0 " << r.repeatable << "\n";
+    for (const auto& s : me.spells)
+        out << s.id << " CAST " << lanes(s.delta) << " 0 -1 -1 " << s.castable << " "
+            << s.repeatable << "\n";
+    for (const auto& s : opponent.spells)
+        out << s.id << " OPPONENT_CAST " << lanes(s.delta) << " 0 -1 -1 " << s.castable << " "
+            << s.repeatable << "\n";
+    out << lanes(me.witch.inv) << " " << me.witch.score << "\n";
+    out << lanes(opponent.witch.inv) << " " << opponent.witch.score << "\n";
+
+    return out.str();
+}
+
+// Checks the command against the state before the round; both players'
+// commands are checked before either is applied.
+bool Referee::parse(const int& player, const std::string& line, Command& command) {
+    Player& p = players[player];
+    std::istringstream in(line);
+    std::string type, times;
+    int id = -1;
+    in >> type;
+
+    auto fail = [&p, &line](const char* reason) {
+        p.error = std::string(reason) + ": " + line;
+        return false;
+    };
+
+    if (type == "WAIT") {
+        command.type = Command::WAIT;
+        return true;
+    }
+    if (type == "REST") {
+        command.type = Command::REST;
+        return true;
+    }
+
+    if (!(in >> id))
+        return fail("missing id");
+
+    if (type == "BREW") {
+        auto order = std::find_if(orders.begin(), orders.end(),
+            [id](const Order& o) { return o.id == id; });
+        if (order == orders.end())
+            return fail("no such order");
+        if (!p.witch.inv.canApply(order->delta))
+            return fail("not enough ingredients");
+        command.type = Command::BREW;
+        command.index = int(order - orders.begin());
+        return true;
+    }
+
+    if (type == "LEARN") {
+        auto recipe = std::find_if(recipes.begin(), recipes.end(),
+            [id](const Recipe& r) { return r.id == id; });
+        if (recipe == recipes.end())
+            return fail("no such spell in the tome");
+        command.type = Command::LEARN;
+        command.index = int(recipe - recipes.begin());
+        if (p.witch.inv[0] < command.index)
+            return fail("not enough tax");
+        return true;
+    }
+
+    if (type == "CAST") {
+        auto spell = std::find_if(p.spells.begin(), p.spells.end(),
+            [id](const Spell& s) { return s.id == id; });
+        if (spell == p.spells.end())
+            return fail("no such spell");
+        command.type = Command::CAST;
+        command.index = int(spell - p.spells.begin());
+        // anything after the id that isn't a number is a message
+        if (in >> times && std::all_of(times.begin(), times.end(), ::isdigit))
+            command.times = std::atoi(times.c_str());
+        if (!spell->castable)
+            return fail("spell exhausted");
+        if (command.times < 1 || (command.times > 1 && !spell->repeatable))
+            return fail("spell not repeatable");
+        if (command.times > spell->maxTimes ||
+            !p.witch.inv.canApply(spell->repeatedDeltas[command.times - 1]))
+            return fail("not enough ingredients or space");
+        return true;
+    }
+
+    return fail("unknown command");
+}
+
+void Referee::play(const std::string (&lines)[PLAYER_COUNT]) {
+    Command commands[PLAYER_COUNT];
+    for (int p = 0; p < PLAYER_COUNT; ++p)
+        players[p].disqualified = !parse(p, lines[p], commands[p]);
+    if (isOver())
+        return;
+
+    bool brewed[VISIBLE_ORDER_COUNT] = {};
+    bool learned[VISIBLE_RECIPE_COUNT] = {};
+    int taxPaid[VISIBLE_RECIPE_COUNT] = {};
+
+    for (int p = 0; p < PLAYER_COUNT; ++p) {
+        const Command& c = commands[p];
+        Player& player = players[p];
+        Witch& witch = player.witch;
+
+        switch (c.type) {
+            case Command::BREW:
+                witch.inv += orders[c.index].delta;
+                witch.score += orders[c.index].price + bonus(c.index);
+                ++player.ordersDone;
+                brewed[c.index] = true;
+                break;
+            case Command::CAST:
+                witch.inv += player.spells[c.index].repeatedDeltas[c.times - 1];
+                player.spells[c.index].castable = false;
+                break;
+            case Command::LEARN: {
+                // tax already on the spell is taken before this round's is
+                // paid, so neither player gets what the other pays
+                const Recipe& recipe = recipes[c.index];
+                witch.inv += Delta(-c.index, 0, 0, 0);
+                int gained = std::min(recipe.taxCount, Delta::MAX_INVENTORY - witch.inv.sum());
+                witch.inv += Delta(gained, 0, 0, 0);
+                player.spells.emplace_back(nextSpellId++, recipe.delta, true, recipe.repeatable);
+                for (int i = 0; i < c.index; ++i)
+                    ++taxPaid[i];
+                learned[c.index] = true;
+                break;
+            }
+            case Command::REST:
+                for (auto& spell : player.spells)
+                    spell.castable = true;
+                break;
+            case Command::WAIT:
+                break;
+        }
+    }
+
+    int firstBonusesUsed = 0, secondBonusesUsed = 0;
+    for (int i = 0; i < VISIBLE_ORDER_COUNT; ++i)
+        if (brewed[i]) {
+            firstBonusesUsed += bonus(i) == FIRST_BONUS;
+            secondBonusesUsed += bonus(i) == SECOND_BONUS;
+        }
+    firstBonusesLeft -= firstBonusesUsed;
+    secondBonusesLeft -= secondBonusesUsed;
+
+    for (int i = int(recipes.size()) - 1; i >= 0; --i) {
+        recipes[i].taxCount += taxPaid[i];
+        if (learned[i])
+            recipes.erase(recipes.begin() + i);
+    }
+    for (int i = int(orders.size()) - 1; i >= 0; --i)
+        if (brewed[i])
+            orders.erase(orders.begin() + i);
+    refill();
+
+    ++roundNumber;
+}
+
+void Referee::forfeit(const int& player, const std::string& reason) {
+    players[player].disqualified = true;
+    players[player].error = reason;
+}
+
+void Referee::refill() {
+    while (int(orders.size()) < VISIBLE_ORDER_COUNT && !orderDeck.empty()) {
+        orders.push_back(orderDeck.back());
+        orderDeck.pop_back();
+    }
+    while (int(recipes.size()) < VISIBLE_RECIPE_COUNT && !recipeDeck.empty()) {
+        recipes.push_back(recipeDeck.back());
+        recipeDeck.pop_back();
+    }
+    for (int i = 0; i < int(recipes.size()); ++i)
+        recipes[i].tomeIndex = i;
+}
+
+// Once the first bonuses run out, the second ones move to the first order.
+int Referee::bonus(const int& slot) const {
+    if (slot == 0)
+        return firstBonusesLeft > 0 ? FIRST_BONUS : secondBonusesLeft > 0 ? SECOND_BONUS : 0;
+    if (slot == 1)
+        return firstBonusesLeft > 0 && secondBonusesLeft > 0 ? SECOND_BONUS : 0;
+    return 0;
+}
+
+int Referee::bonusesLeft(const int& slot) const {
+    if (bonus(slot) == 0)
+        return 0;
+    return bonus(slot) == FIRST_BONUS ? firstBonusesLeft : secondBonusesLeft;
+}
+
+bool Referee::isOver() const {
+    if (roundNumber >= MAX_ROUNDS)
+        return true;
+    for (const auto& player : players)
+        if (player.disqualified || player.ordersDone >= WINNING_ORDER_COUNT)
+            return true;
+    return false;
+}
+
+int Referee::round() const {
+    return roundNumber;
+}
+
+int Referee::finalScore(const int& player) const {
+    const Delta& inv = players[player].witch.inv;
+    return players[player].witch.score + inv[1] + inv[2] + inv[3];
+}
+
+int Referee::result(const int& player) const {
+    bool lost = players[player].disqualified;
+    bool won = players[1 - player].disqualified;
+    if (lost == won) {
+        if (lost || finalScore(player) == finalScore(1 - player))
+            return -1;
+        return finalScore(player) > finalScore(1 - player);
+    }
+    return won;
+}
+
+bool Referee::isDisqualified(const int& player) const {
+    return players[player].disqualified;
+}
+
+const std::string& Referee::error(const int& player) const {
+    return players[player].error;
+}
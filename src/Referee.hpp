@@ -0,0 +1,83 @@
+#ifndef REFEREE_HPP
+#define REFEREE_HPP
+
+#include "Action.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One game between two players under the contest rules: the order and
+// tome decks are shuffled from a seed, the first two orders carry the
+// urgency bonuses, learning pays tax onto the spells before it in the
+// tome, and the game ends after the round someone brews a sixth potion
+// or after round 100. frame() is the input of a round as the online
+// referee prints it, so an agent can't tell the two apart.
+class Referee {
+public:
+    static constexpr int PLAYER_COUNT = 2;
+    static constexpr int MAX_ROUNDS = 100;
+    static constexpr int WINNING_ORDER_COUNT = 6;
+    static constexpr int VISIBLE_ORDER_COUNT = 5;
+    static constexpr int VISIBLE_RECIPE_COUNT = 6;
+    static constexpr int URGENCY_BONUS_COUNT = 4;
+    static constexpr int FIRST_BONUS = 3;
+    static constexpr int SECOND_BONUS = 1;
+    static constexpr int FIRST_LEARNED_ID = 86;
+
+    explicit Referee(const uint32_t& seed);
+
+    std::string frame(const int& player) const;
+    // Plays one round. A player whose command can't be played loses the
+    // game on the spot, as online.
+    void play(const std::string (&commands)[PLAYER_COUNT]);
+    // For a player that didn't answer in time.
+    void forfeit(const int& player, const std::string& reason);
+
+    bool isOver() const;
+    int round() const;
+    // Rupees plus a point for every ingredient above tier 0.
+    int finalScore(const int& player) const;
+    // 1 if player won, 0 if it lost and -1 on a draw.
+    int result(const int& player) const;
+    bool isDisqualified(const int& player) const;
+    const std::string& error(const int& player) const;
+
+private:
+    struct Command {
+        enum Type {
+            BREW,
+            CAST,
+            LEARN,
+            REST,
+            WAIT
+        } type = WAIT;
+        int index = 0;
+        int times = 1;
+    };
+
+    struct Player {
+        Witch witch;
+        std::vector<Spell> spells;
+        int ordersDone = 0;
+        bool disqualified = false;
+        std::string error;
+    };
+
+    bool parse(const int& player, const std::string& line, Command& command);
+    void refill();
+    int bonus(const int& slot) const;
+    int bonusesLeft(const int& slot) const;
+
+    Player players[PLAYER_COUNT];
+    std::vector<Order> orders;
+    std::vector<Order> orderDeck;
+    std::vector<Recipe> recipes;
+    std::vector<Recipe> recipeDeck;
+    int firstBonusesLeft = URGENCY_BONUS_COUNT;
+    int secondBonusesLeft = URGENCY_BONUS_COUNT;
+    int roundNumber = 0;
+    int nextSpellId = FIRST_LEARNED_ID;
+};
+
+#endif /* REFEREE_HPP */
@@ -0,0 +1,964 @@
+#include "SearchEngine.hpp"
+#include "Beam.hpp"
+#include "Mcts.hpp"
+#include "Options.hpp"
+#include "Stats.hpp"
+
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cmath>
+#include <sstream>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable<State>::value,
+    "states are memcpy'd and expanded on several threads");
+
+bool State::operator<(const State& s) const {
+    return evaluation < s.evaluation;
+}
+
+bool State::operator>(const State& s) const {
+    return evaluation > s.evaluation;
+}
+
+bool State::isCastable(const int& i) const {
+    return castableSpellsMask & 1 << i;
+}
+
+bool State::isOrderDoable(const int& i) const {
+    return ordersTodoMask & 1 << i;
+}
+
+bool State::isRecipeDoable(const int& i) const {
+    return recipesTodoMask & 1 << i;
+}
+
+// Packs everything that tells two states of the same layer apart into 47
+// bits: the inventory index, then the spell, order, recipe and
+// learnt-spell masks.
+uint64_t State::key() const {
+    static_assert(SearchEngine::MAX_SPELL_COUNT <= 20, "spell mask doesn't fit the key");
+    static_assert(SearchEngine::MAX_ORDER_COUNT <= 5, "order mask doesn't fit the key");
+    static_assert(SearchEngine::MAX_RECIPE_COUNT <= 6, "recipe mask doesn't fit the key");
+
+    static_assert(Inventory::COUNT <= 1 << 10, "inventory index doesn't fit the key");
+
+    return uint64_t(inv) |
+        uint64_t(castableSpellsMask) << 10 |
+        uint64_t(ordersTodoMask) << 30 |
+        uint64_t(recipesTodoMask) << 35 |
+        uint64_t(castableSpellsFromRecipesMask) << 41;
+}
+
+// The evaluation accumulated along the path plus part of the price of the
+// best open order the state could brew within a few more casts, decayed
+// as if it had been brewed after that many more moves.
+template<typename P>
+eval_t State::evaluateLeaf(const SearchEngine& engine) const {
+    const auto& p = P::get(engine.params);
+    eval_t nearOrder = 0;
+    int ordersTodoMask = this->ordersTodoMask;
+    while (ordersTodoMask) {
+        int nextOrderBit = low(ordersTodoMask);
+        int i = bits(nextOrderBit);
+        int distance = engine.orderDistance(inv, i);
+        if (distance <= Options::MAX_NEAR_ORDER_DISTANCE) {
+            eval_t value = engine.orders[i].price * p.nearOrderDecay[distance];
+            if (depth + distance + 1 > engine.rivalBrewTurns[i])
+                value *= p.rivalDiscount;
+            nearOrder = std::max(nearOrder, value);
+        }
+        ordersTodoMask ^= nextOrderBit;
+    }
+
+    return evaluation + 100 * gamma * nearOrder;
+}
+
+eval_t State::leafEvaluation(const SearchEngine& engine) const {
+    if (engine.tuned)
+        return evaluateLeaf<Options::Runtime>(engine);
+    return evaluateLeaf<Options::Compiled>(engine);
+}
+
+namespace {
+    // Multiversioned here rather than as State::getNeighbors: GCC 12 only
+    // emits the clones in the file defining them, so a caller in another
+    // one, under LTO, can't link to them. Flattened, so the generators are
+    // compiled for each clone's instruction set too.
+    MULTIVERSION __attribute__((flatten)) int neighborsOf(const State& state,
+        const SearchEngine& engine, State* neighbors) {
+        if (engine.tuned)
+            return state.generateNeighbors<Options::Runtime>(engine, neighbors);
+        return state.generateNeighbors<Options::Compiled>(engine, neighbors);
+    }
+}
+
+int State::getNeighbors(const SearchEngine& engine, State* neighbors) const {
+    STATS_TIME(EXPAND);
+    int neighborCount = neighborsOf(*this, engine, neighbors);
+    STATS_COUNT(NEIGHBOR_CALLS, 1);
+    STATS_COUNT(NEIGHBORS, neighborCount);
+    return neighborCount;
+}
+
+// Not specialized per spell, order or recipe count: copies with those
+// fixed and the loops over them unrolled were no faster than this one
+// built for the host's instruction set, and doubled the code.
+template<typename P>
+int State::generateNeighbors(const SearchEngine& engine, State* neighbors) const {
+    int neighborCount = 0;
+
+    if (ordersDone == 6) {
+        getRestAction<P>(engine, neighbors, neighborCount);
+        return neighborCount;
+    }
+
+    getSpellActions<P>(engine, neighbors, neighborCount);
+    getOrderActions<P>(engine, neighbors, neighborCount);
+    getRecipeActions<P>(engine, neighbors, neighborCount);
+    getRestAction<P>(engine, neighbors, neighborCount);
+
+    return neighborCount;
+}
+
+template<typename P>
+void State::getSpellActions(const SearchEngine& engine, State* neighbors,
+    int& neighborCount) const {
+    int castableSpellsMask = this->castableSpellsMask;
+    while (castableSpellsMask) {
+        int nextSpellBit = low(castableSpellsMask);
+        assert(__builtin_popcount(nextSpellBit) == 1);
+
+        int i = bits(nextSpellBit);
+        assert(nextSpellBit == (1 << i));
+        castSpell<P>(engine, i, neighbors, neighborCount);
+
+        assert((castableSpellsMask & nextSpellBit) == nextSpellBit);
+        castableSpellsMask ^= nextSpellBit;
+    }
+}
+
+template<typename P>
+void State::castSpell(const SearchEngine& engine, const int& i, State* neighbors,
+    int& neighborCount) const {
+    assert(0 <= i && i < engine.spellCount);
+    const auto& p = P::get(engine.params);
+    const auto& s = engine.spells[i];
+    const inv_t* next = engine.transitionRow(inv) + engine.spellCastSlots[i];
+    for (int j = 0; j < s.maxTimes; ++j) {
+        if (next[j] == Inventory::NONE)
+            break;
+
+        auto& neighbor = neighbors[neighborCount++];
+        std::memcpy(&neighbor, this, sizeof(State));
+        neighbor.inv = next[j];
+        neighbor.castableSpellsMask ^= 1 << i;
+        neighbor.gamma *= p.decay;
+        ++neighbor.depth;
+        neighbor.evaluation += Inventory::eval(next[j]) - Inventory::eval(inv) - p.castableValue;
+
+        neighbor.recordAction(SearchEngine::FIRST_CAST_ACTION + engine.spellCastSlots[i] + j);
+    }
+}
+
+template<typename P>
+void State::getOrderActions(const SearchEngine& engine, State* neighbors,
+    int& neighborCount) const {
+    const inv_t* next = engine.transitionRow(inv) + engine.orderSlot;
+    int ordersTodoMask = this->ordersTodoMask;
+    while (ordersTodoMask) {
+        int nextOrderBit = low(ordersTodoMask);
+        assert(__builtin_popcount(nextOrderBit) == 1);
+
+        int i = bits(nextOrderBit);
+        assert(nextOrderBit == (1 << i));
+        brewOrder<P>(engine, i, next, neighbors, neighborCount);
+
+        assert((ordersTodoMask & nextOrderBit) == nextOrderBit);
+        ordersTodoMask ^= nextOrderBit;
+    }
+}
+
+template<typename P>
+void State::brewOrder(const SearchEngine& engine, const int& i, const inv_t* next,
+    State* neighbors, int& neighborCount) const {
+    assert(0 <= i && i < engine.orderCount);
+    if (next[i] == Inventory::NONE)
+        return;
+
+    const auto& p = P::get(engine.params);
+    const auto& order = engine.orders[i];
+    auto& neighbor = neighbors[neighborCount++];
+    std::memcpy(&neighbor, this, sizeof(State));
+    neighbor.inv = next[i];
+    neighbor.score += order.price;
+    neighbor.ordersTodoMask ^= 1 << i;
+    neighbor.gamma *= p.decay;
+    ++neighbor.depth;
+    eval_t value = 100 * gamma * order.price *
+        (neighbor.depth > engine.rivalBrewTurns[i] ? p.rivalDiscount : 1.f);
+    neighbor.evaluation += value;
+    neighbor.discounted += value;
+    if (++neighbor.ordersDone == 6)
+        neighbor.evaluation += p.lastOrderBonus;
+
+    neighbor.recordAction(i);
+}
+
+template<typename P>
+void State::getRecipeActions(const SearchEngine& engine, State* neighbors,
+    int& neighborCount) const {
+    // our spells, learnt ones included, have to fit the key's mask; those
+    // already learnt on this line stay castable
+    int learnt = engine.recipeCount - __builtin_popcount(recipesTodoMask);
+    bool canLearn = engine.spellCount + learnt < SearchEngine::MAX_SPELL_COUNT;
+    for (int i = 0; i < engine.recipeCount; ++i)
+        useRecipe<P>(engine, i, canLearn, neighbors, neighborCount);
+}
+
+template<typename P>
+void State::useRecipe(const SearchEngine& engine, const int& i, const bool& canLearn,
+    State* neighbors, int& neighborCount) const {
+    const auto& p = P::get(engine.params);
+    if (recipesTodoMask & 1 << i) {
+        const auto& recipe = engine.recipes[i];
+
+        if (canLearn && Inventory::delta(inv)[0] >= recipe.tomeIndex) {
+            auto& neighbor = neighbors[neighborCount++];
+            std::memcpy(&neighbor, this, sizeof(State));
+            neighbor.recipesTodoMask ^= 1 << i;
+            neighbor.gamma *= p.decay;
+            ++neighbor.depth;
+            eval_t value = gamma * std::pow(p.learnDecay, recipesLearnt) *
+                (1 - recipe.tomeIndex / 3.f + recipe.taxCount / 6.f);
+            neighbor.evaluation += value;
+            neighbor.discounted += value;
+            neighbor.recipesLearnt++;
+
+            neighbor.recordAction(SearchEngine::MAX_ORDER_COUNT + i);
+        }
+    }
+    else if (castableSpellsFromRecipesMask & 1 << i) {
+        const auto& s = engine.spellsFromRecipes[i];
+        const inv_t* next = engine.transitionRow(inv) + engine.recipeCastSlots[i];
+        for (int j = 0; j < s.maxTimes; ++j) {
+            if (next[j] == Inventory::NONE)
+                break;
+
+            auto& neighbor = neighbors[neighborCount++];
+            std::memcpy(&neighbor, this, sizeof(State));
+            neighbor.inv = next[j];
+            neighbor.castableSpellsFromRecipesMask ^= 1 << i;
+            neighbor.gamma *= p.decay;
+            ++neighbor.depth;
+            neighbor.evaluation += Inventory::eval(next[j]) - Inventory::eval(inv) - p.castableValue;
+
+            assert(firstAction != SearchEngine::NO_ACTION);
+            neighbor.recordAction(SearchEngine::UNKNOWN_ACTION);
+        }
+    }
+}
+
+template<typename P>
+void State::getRestAction(const SearchEngine& engine, State* neighbors,
+    int& neighborCount) const {
+    const auto& p = P::get(engine.params);
+    auto& neighbor = neighbors[neighborCount++];
+    std::memcpy(&neighbor, this, sizeof(State));
+    int turnOnCount = engine.spellCount - __builtin_popcount(neighbor.castableSpellsMask) +
+        engine.recipeCount - __builtin_popcount(neighbor.castableSpellsFromRecipesMask);
+    neighbor.castableSpellsMask = (1 << engine.spellCount) - 1;
+    neighbor.castableSpellsFromRecipesMask = (1 << engine.recipeCount) - 1;
+    neighbor.gamma *= p.decay;
+    ++neighbor.depth;
+    neighbor.evaluation += turnOnCount * p.castableValue;
+
+    neighbor.recordAction(SearchEngine::REST_ACTION);
+}
+
+void SearchStats::reset() {
+    depth = width = seeded = 0;
+    expanded = generated = duplicates = 0;
+    aborted = false;
+    time = overshoot = 0;
+    layerTimes.clear();
+    layerDuplicates.clear();
+}
+
+SearchEngine::SearchEngine() :
+    spellCount(0), orderCount(0), recipeCount(0), opponentSpellCount(0),
+    transitionStride(0), orderSlot(0), maxNeighbors(0),
+    engine(Engine::BEAM), params(Options::DEFAULTS), tuned(false),
+    beamWidth(Options::DEFAULTS.beamWidth), threadCount(1),
+    firstTurnTimeLimit(1000), turnTimeLimit(50), deadlineMargin(5),
+    layers(new Beam[LAYER_COUNT]), reuseSearch(true), mcts(new Mcts(*this)),
+    bestLeaf(new State()) {
+
+    newGame();
+}
+
+SearchEngine::~SearchEngine() = default;
+
+// Forgets everything learnt about the previous game.
+void SearchEngine::newGame() {
+    playerOrdersDone = enemyOrdersDone = 0;
+    lastPlayerScore = lastEnemyScore = 0;
+    roundNumber = recipeDoneCount = 0;
+    carried.clear();
+    carriedSignature = carriedKey = 0;
+    mcts->forget();
+}
+
+void SearchEngine::setParams(const Options::Params& params) {
+    this->params = params;
+    this->params.derive();
+    tuned = !Options::isDefault(this->params);
+    beamWidth = std::max(1, params.beamWidth);
+}
+
+Decision SearchEngine::decide(const Snapshot& snapshot,
+    const Timer::Clock::time_point& received) {
+    load(snapshot);
+    // #ifdef DEBUG
+    // writeData();
+    // #endif
+
+    Decision decision;
+    decision.action = pickAction(received);
+    if (engine == Engine::MCTS)
+        decision.mcts = mcts->stats;
+    else
+        decision.search = stats;
+
+    if (dynamic_cast<const Recipe*>(decision.action))
+        ++recipeDoneCount;
+
+#ifdef STATS
+    if (engine == Engine::MCTS)
+        Stats::report(roundNumber, decision.mcts.iterations, decision.mcts.depth);
+    else
+        Stats::report(roundNumber, decision.search.expanded, decision.search.depth);
+#endif
+
+    ++roundNumber;
+    return decision;
+}
+
+// Copies the turn into the fixed size tables the search indexes and
+// builds everything else it needs for the turn on top of them.
+void SearchEngine::load(const Snapshot& snapshot) {
+    assert(snapshot.spells.size() <= MAX_SPELL_COUNT);
+    assert(snapshot.orders.size() <= MAX_ORDER_COUNT);
+    assert(snapshot.recipes.size() <= MAX_RECIPE_COUNT);
+    assert(snapshot.opponentSpells.size() <= MAX_OPPONENT_SPELL_COUNT);
+
+    spellCount = int(snapshot.spells.size());
+    std::copy(snapshot.spells.begin(), snapshot.spells.end(), spells.begin());
+    orderCount = int(snapshot.orders.size());
+    std::copy(snapshot.orders.begin(), snapshot.orders.end(), orders.begin());
+    recipeCount = int(snapshot.recipes.size());
+    for (int i = 0; i < recipeCount; ++i) {
+        recipes[i] = snapshot.recipes[i];
+        spellsFromRecipes[i] = recipes[i];
+    }
+    opponentSpellCount = int(snapshot.opponentSpells.size());
+    std::copy(snapshot.opponentSpells.begin(), snapshot.opponentSpells.end(),
+        opponentSpells.begin());
+
+    player = snapshot.player;
+    opponent = snapshot.opponent;
+
+    if (player.score != lastPlayerScore) {
+        lastPlayerScore = player.score;
+        ++playerOrdersDone;
+    }
+
+    if (opponent.score != lastEnemyScore) {
+        lastEnemyScore = opponent.score;
+        ++enemyOrdersDone;
+    }
+
+    buildTables();
+}
+
+// The opponent's distances don't depend on our tables, so with a second
+// worker they are computed alongside them.
+void SearchEngine::buildTables() {
+    workers.resize(threadCount);
+    auto build = [this](int worker) {
+        if (worker == 0) {
+            buildActionTable();
+            buildTransitions();
+            buildOrderDistances();
+        }
+        if (worker == 1 || workers.size() == 1)
+            buildRivalBrewTurns();
+    };
+
+    if (workers.size() == 1)
+        build(0);
+    else
+        workers.run(build);
+}
+
+void SearchEngine::report(const Decision& decision) const {
+    if (engine == Engine::MCTS) {
+        debug("MCTS iterations:", decision.mcts.iterations, decision.mcts.nodes,
+            decision.mcts.reused);
+        debug(decision.mcts.time, decision.mcts.overshoot);
+    }
+    else {
+        debug(describe(*bestLeaf));
+        debug("Beam search depth:", decision.search.depth, decision.search.seeded);
+        debug(decision.search.time, decision.search.overshoot, decision.search.aborted);
+    }
+
+    if (dynamic_cast<const Recipe*>(decision.action)) {
+        debug("MAKING RECIPE");
+        debug(recipeDoneCount);
+    }
+}
+
+#ifdef DEBUG
+void SearchEngine::writeData() const {
+    for (const auto& order : orders)
+        debug(order);
+    for (const auto& spell : spells)
+        debug(spell);
+    for (const auto& recipe : recipes)
+        debug(recipe);
+    for (const auto& spellFromRecipe : spellsFromRecipes)
+        debug(spellFromRecipe);
+}
+#endif
+
+const Action* SearchEngine::pickAction(const Timer::Clock::time_point& received) {
+    // if (roundNumber < 6)
+        // return chooseRecipe();
+    float timeLimit = roundNumber == 0 ? firstTurnTimeLimit : turnTimeLimit;
+    // the first turn also pays for starting the process, before received
+    float margin = roundNumber == 0 ? 4 * deadlineMargin : deadlineMargin;
+    // short limits, as given to the tuner or with -t, keep most of theirs
+    margin = std::min(margin, timeLimit / 4);
+    Timer timer(timeLimit - margin, received);
+    if (engine == Engine::MCTS)
+        return mcts->search(timer);
+    return search(timer);
+}
+
+int SearchEngine::roundsLeft() const {
+    static_assert(MAX_ROUNDS < UNREACHABLE, "depths must compare below UNREACHABLE");
+    static_assert(MAX_ROUNDS <= UINT16_MAX, "depths must fit State::depth");
+    return std::max(1, MAX_ROUNDS - roundNumber);
+}
+
+const Action* SearchEngine::chooseRecipe() {
+    return &recipes.front();
+}
+
+const Action* SearchEngine::search(float timeLimit, int maxDepth) {
+    return search(Timer(timeLimit), maxDepth);
+}
+
+const Action* SearchEngine::search(const Timer& timer, int maxDepth) {
+    maxDepth = std::min(maxDepth, roundsLeft());
+    workers.resize(threadCount);
+    reserveBuffers();
+    Beam* current = &layers[0];
+    Beam* next = &layers[1];
+    int currentCount = 1, nextCount = 0;
+    State root = getInitialState();
+    current->states[0] = root;
+
+    stats.reset();
+    int depth = 0;
+    int seedDepth = takeSeeds(root);
+
+    // Any layer but the root's may be abandoned half-way once time is up;
+    // the answer then comes from the last layer that was fully selected.
+    // The root's is searched even past the deadline, for a move to play.
+    for (; depth < maxDepth && (depth == 0 || timer.isTimeLeft()); ++depth) {
+        assert(currentCount > 0);
+        float layerStart = timer.elapsed();
+        const Timer* deadline = depth > 0 ? &timer : nullptr;
+
+        bool completed = expand(*current, currentCount, *next, deadline);
+        for (const auto& slice : slices)
+            nextCount += slice.count;
+        stats.expanded += currentCount;
+        stats.generated += nextCount;
+
+        if (!completed) {
+            stats.aborted = true;
+            break;
+        }
+
+        if (depth + 1 == seedDepth) {
+            int seedBegin = beamWidth * maxNeighbors;
+            std::copy(carried.begin(), carried.end(), next->states + seedBegin);
+            next->index(seedBegin, int(carried.size()));
+            slices.push_back({ seedBegin, int(carried.size()) });
+            nextCount += int(carried.size());
+            stats.seeded = int(carried.size());
+        }
+
+        int uniqueCount = removeDuplicates(*next, deadline);
+        if (uniqueCount == -1) {
+            stats.aborted = true;
+            break;
+        }
+        stats.duplicates += nextCount - uniqueCount;
+        stats.layerDuplicates.push_back(nextCount - uniqueCount);
+        nextCount = uniqueCount;
+
+        assert(nextCount > 0);
+        int selectedCount = selectBest(*next, nextCount, *current, deadline);
+        if (selectedCount == -1) {
+            stats.aborted = true;
+            break;
+        }
+        currentCount = selectedCount;
+        nextCount = 0;
+
+        stats.layerTimes.push_back(timer.elapsed() - layerStart);
+    }
+
+    // The previous search got deeper than this one did in time.
+    if (depth < seedDepth) {
+        std::copy(carried.begin(), carried.end(), current->states);
+        currentCount = int(carried.size());
+        stats.seeded = currentCount;
+        depth = seedDepth;
+    }
+
+    stats.depth = depth;
+    stats.width = currentCount;
+    stats.time = timer.elapsed();
+    stats.overshoot = stats.time - timer.limit();
+    assert(currentCount > 0);
+    const auto& finalState = *std::max_element(current->states, current->states + currentCount,
+        [this](const State& a, const State& b) {
+            return a.leafEvaluation(*this) < b.leafEvaluation(*this);
+        });
+    *bestLeaf = finalState;
+
+    // only with maxDepth 0 is there no first move; resting is always legal
+    action_id_t action = finalState.firstAction;
+    if (action >= UNKNOWN_ACTION)
+        action = REST_ACTION;
+    carryOver(root, *current, currentCount, action);
+    return actions[action];
+}
+
+// Returns the depth the carried states are at from root, or -1 if they
+// don't apply to it.
+int SearchEngine::takeSeeds(const State& root) {
+    if (!reuseSearch || carried.empty() ||
+        carriedSignature != tableSignature() || carriedKey != root.key()) {
+        carried.clear();
+        return -1;
+    }
+    if (int(carried.size()) > beamWidth)
+        carried.resize(beamWidth);
+    return carried.front().depth;
+}
+
+// Keeps the states of layer whose line starts with action, as seen from
+// the state that action leads to: second moves become first ones and the
+// part of the evaluation weighted by gamma after the first move is scaled
+// back by one decay.
+void SearchEngine::carryOver(const State& root, const Beam& layer, const int& count,
+    const action_id_t& action) {
+
+    carriedNext.clear();
+    if (!reuseSearch)
+        return;
+
+    State* children = layers[1].states;
+    int childCount = root.getNeighbors(*this, children);
+    const State* child = std::find_if(children, children + childCount,
+        [action](const State& s) { return s.firstAction == action; });
+    assert(child != children + childCount);
+
+    eval_t childRootEvaluation = rootEvaluation(*child);
+    for (int i = 0; i < count; ++i) {
+        const State& s = layer.states[i];
+        if (s.firstAction != action || s.secondAction >= UNKNOWN_ACTION)
+            continue;
+
+        State seed = s;
+        seed.firstAction = s.secondAction;
+        seed.secondAction = UNKNOWN_ACTION;
+        reroot(seed, *child, childRootEvaluation);
+        carriedNext.push_back(seed);
+    }
+
+    std::swap(carried, carriedNext);
+    carriedSignature = tableSignature();
+    carriedKey = child->key();
+}
+
+void SearchEngine::reroot(State& s, const State& next, const eval_t& nextRootEvaluation) const {
+    // inventory and spell terms don't depend on depth, only the order and
+    // recipe values do
+    eval_t discounted = (s.discounted - next.discounted) / params.decay;
+    s.evaluation = nextRootEvaluation + (s.evaluation - s.discounted) -
+        (next.evaluation - next.discounted) + discounted;
+    s.discounted = discounted;
+    s.gamma /= params.decay;
+    --s.depth;
+}
+
+// Identifies this turn's spells, orders and recipes, the things state
+// masks and action ids are relative to.
+uint64_t SearchEngine::tableSignature() const {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&hash](const int& value) {
+        hash = (hash ^ uint32_t(value)) * 0x100000001b3ull;
+    };
+
+    mix(spellCount);
+    for (int i = 0; i < spellCount; ++i)
+        mix(spells[i].id);
+    mix(orderCount);
+    for (int i = 0; i < orderCount; ++i) {
+        mix(orders[i].id);
+        mix(orders[i].price);
+    }
+    mix(recipeCount);
+    for (int i = 0; i < recipeCount; ++i)
+        mix(recipes[i].id);
+    return hash;
+}
+
+// Leaves room for a layer of carried states after the children.
+void SearchEngine::reserveBuffers() {
+    size_t maxStates = size_t(beamWidth) * (maxNeighbors + 1);
+    for (int i = 0; i < LAYER_COUNT; ++i)
+        layers[i].reserve(int(maxStates));
+    if (candidates.size() < maxStates) {
+        survivors.resize(maxStates);
+        candidates.resize(maxStates);
+    }
+    transpositions.reserve(int(maxStates));
+}
+
+// Generates the children of all parents into slices of children. With a
+// timer, the clock is sampled every TIME_CHECK_INTERVAL parents and false
+// is returned, leaving the layer incomplete, once it has run out. Every
+// worker takes a contiguous run of parents and writes into the part of
+// the buffer reserved for them, so no synchronisation is needed until the
+// slices are merged in removeDuplicates(). Narrow layers, the root among
+// them, aren't worth waking the workers for. The scanned fields of the
+// children are filled right away, while they are still in L1.
+bool SearchEngine::expand(const Beam& parents, const int& parentCount, Beam& children,
+    const Timer* timer) {
+
+    auto expandOne = [this, &parents, &children](const int& i, const int& at) {
+        int neighborCount = parents.states[i].getNeighbors(*this, children.states + at);
+        children.index(at, neighborCount);
+        return neighborCount;
+    };
+
+    int workerCount = std::min(workers.size(), parentCount / MIN_PARENTS_PER_THREAD);
+    if (workerCount <= 1) {
+        int childCount = 0;
+        for (int i = 0; i < parentCount; ++i) {
+            if (timer && i % TIME_CHECK_INTERVAL == 0 && i > 0 && !timer->isTimeLeft()) {
+                slices.assign(1, { 0, childCount });
+                return false;
+            }
+            childCount += expandOne(i, childCount);
+        }
+        slices.assign(1, { 0, childCount });
+        return true;
+    }
+
+    std::atomic<bool> timeUp(false);
+    slices.assign(workerCount, { 0, 0 });
+    workers.run([&](int worker) {
+        if (worker >= workerCount)
+            return;
+
+        int begin = int(int64_t(parentCount) * worker / workerCount);
+        int end = int(int64_t(parentCount) * (worker + 1) / workerCount);
+        int childBegin = begin * maxNeighbors;
+        int childCount = 0;
+        for (int i = begin; i < end; ++i) {
+            if (timer && (i - begin) % TIME_CHECK_INTERVAL == 0 && i > begin) {
+                if (timeUp.load(std::memory_order_relaxed))
+                    break;
+                if (!timer->isTimeLeft()) {
+                    timeUp.store(true, std::memory_order_relaxed);
+                    break;
+                }
+            }
+            childCount += expandOne(i, childBegin + childCount);
+        }
+        slices[worker] = { childBegin, childCount };
+    });
+
+    return !timeUp.load();
+}
+
+// Keeps only the best evaluated copy of every state key, merging the
+// slices into the indices of the survivors. Only keys and evaluations are
+// read; no state is moved. Returns how many are left, or
+// -1 if the timer ran out first.
+int SearchEngine::removeDuplicates(const Beam& states, const Timer* timer) {
+    transpositions.clear();
+
+    int uniqueCount = 0, seen = 0;
+    for (const auto& slice : slices)
+        for (int i = slice.begin; i < slice.begin + slice.count; ++i) {
+            if (timer && ++seen % TIME_CHECK_INTERVAL == 0 && !timer->isTimeLeft())
+                return -1;
+            int j = transpositions.findOrInsert(states.keys[i], uniqueCount);
+            if (j == -1)
+                survivors[uniqueCount++] = i;
+            else if (states.evaluations[survivors[j]] < states.evaluations[i])
+                survivors[j] = i;
+        }
+
+    return uniqueCount;
+}
+
+// Copies the beamWidth best evaluated survivors into selected, in no
+// particular order. Only (evaluation, index) pairs are moved around while
+// selecting; every survivor is copied exactly once. Returns -1, leaving
+// selected untouched, if the timer runs out while scoring the states.
+int SearchEngine::selectBest(const Beam& states, const int& stateCount, Beam& selected,
+    const Timer* timer) {
+
+    STATS_TIME(SELECT);
+    STATS_COUNT(SELECTIONS, 1);
+    for (int i = 0; i < stateCount; ++i) {
+        if (timer && i % TIME_CHECK_INTERVAL == 0 && i > 0 && !timer->isTimeLeft())
+            return -1;
+        candidates[i] = { states.states[survivors[i]].leafEvaluation(*this), survivors[i] };
+    }
+
+    int selectedCount = std::min(beamWidth, stateCount);
+    if (selectedCount < stateCount)
+        std::nth_element(candidates.begin(),
+            candidates.begin() + selectedCount,
+            candidates.begin() + stateCount,
+            std::greater<Candidate>());
+
+    for (int i = 0; i < selectedCount; ++i)
+        selected.states[i] = states.states[candidates[i].index];
+
+    return selectedCount;
+}
+
+void SearchEngine::buildActionTable() {
+    for (int i = 0; i < orderCount; ++i)
+        actions[i] = &orders[i];
+    for (int i = 0; i < recipeCount; ++i)
+        actions[MAX_ORDER_COUNT + i] = &recipes[i];
+    actions[REST_ACTION] = &rest;
+
+    int castCount = 0;
+    for (int i = 0; i < spellCount; ++i) {
+        spellCastSlots[i] = castCount;
+        for (int j = 0; j < spells[i].maxTimes; ++j) {
+            auto& cast = casts[castCount];
+            cast = spells[i];
+            cast.curTimes = j + 1;
+            actions[FIRST_CAST_ACTION + castCount++] = &cast;
+        }
+    }
+}
+
+void SearchEngine::buildTransitions() {
+    transitionStride = 0;
+    for (int i = 0; i < spellCount; ++i) {
+        spellCastSlots[i] = transitionStride;
+        transitionStride += spells[i].maxTimes;
+    }
+    for (int i = 0; i < recipeCount; ++i) {
+        recipeCastSlots[i] = transitionStride;
+        transitionStride += spellsFromRecipes[i].maxTimes;
+    }
+    orderSlot = transitionStride;
+    transitionStride += orderCount;
+    // every cast and order slot, learning each recipe, and rest
+    maxNeighbors = transitionStride + recipeCount + 1;
+
+    slotDeltas.clear();
+    for (int i = 0; i < spellCount; ++i)
+        for (int j = 0; j < spells[i].maxTimes; ++j)
+            slotDeltas.push_back(spells[i].repeatedDeltas[j]);
+    for (int i = 0; i < recipeCount; ++i)
+        for (int j = 0; j < spellsFromRecipes[i].maxTimes; ++j)
+            slotDeltas.push_back(spellsFromRecipes[i].repeatedDeltas[j]);
+    for (int i = 0; i < orderCount; ++i)
+        slotDeltas.push_back(orders[i].delta);
+    assert(int(slotDeltas.size()) == transitionStride);
+    slotBatch.assign(slotDeltas);
+
+    applicable.resize(slotBatch.maskWords());
+    transitions.resize(Inventory::COUNT * transitionStride);
+    for (inv_t inv = 0; inv < Inventory::COUNT; ++inv) {
+        const Delta& from = Inventory::delta(inv);
+        inv_t* row = transitions.data() + inv * transitionStride;
+        std::fill(row, row + transitionStride, Inventory::NONE);
+
+        slotBatch.applicable(from, applicable.data());
+        for (int w = 0; w < int(applicable.size()); ++w)
+            for (uint64_t mask = applicable[w]; mask; mask &= mask - 1) {
+                int k = 64 * w + __builtin_ctzll(mask);
+                row[k] = Inventory::index(from + slotDeltas[k]);
+            }
+    }
+}
+
+// Multi-source BFS backwards from the inventories affording each order,
+// over the cast edges of the transition table.
+void SearchEngine::buildOrderDistances() {
+    int spellCastCount = recipeCount > 0 ? recipeCastSlots[0] : orderSlot;
+
+    predecessorBegin.assign(Inventory::COUNT + 1, 0);
+    for (inv_t inv = 0; inv < Inventory::COUNT; ++inv) {
+        const inv_t* row = transitionRow(inv);
+        for (int k = 0; k < spellCastCount; ++k)
+            if (row[k] != Inventory::NONE)
+                ++predecessorBegin[row[k] + 1];
+    }
+    for (int inv = 0; inv < Inventory::COUNT; ++inv)
+        predecessorBegin[inv + 1] += predecessorBegin[inv];
+
+    predecessors.resize(predecessorBegin[Inventory::COUNT]);
+    predecessorEnd.assign(predecessorBegin.begin(), predecessorBegin.end() - 1);
+    for (inv_t inv = 0; inv < Inventory::COUNT; ++inv) {
+        const inv_t* row = transitionRow(inv);
+        for (int k = 0; k < spellCastCount; ++k)
+            if (row[k] != Inventory::NONE)
+                predecessors[predecessorEnd[row[k]]++] = inv;
+    }
+
+    orderDistances.assign(Inventory::COUNT * MAX_ORDER_COUNT, UNREACHABLE);
+    orderQueue.resize(Inventory::COUNT);
+    for (int i = 0; i < orderCount; ++i) {
+        auto distance = [this, i](const inv_t& inv) -> uint8_t& {
+            return orderDistances[inv * MAX_ORDER_COUNT + i];
+        };
+
+        int head = 0, tail = 0;
+        for (inv_t inv = 0; inv < Inventory::COUNT; ++inv)
+            if (transitionRow(inv)[orderSlot + i] != Inventory::NONE) {
+                distance(inv) = 0;
+                orderQueue[tail++] = inv;
+            }
+
+        while (head < tail) {
+            inv_t inv = orderQueue[head++];
+            if (distance(inv) + 1 >= UNREACHABLE)
+                continue;
+            for (int k = predecessorBegin[inv]; k < predecessorBegin[inv + 1]; ++k) {
+                inv_t previous = predecessors[k];
+                if (distance(previous) == UNREACHABLE) {
+                    distance(previous) = distance(inv) + 1;
+                    orderQueue[tail++] = previous;
+                }
+            }
+        }
+    }
+}
+
+// Forward BFS from the opponent's inventory over its own casts, reading
+// off the first layer that affords each order.
+void SearchEngine::buildRivalBrewTurns() {
+    rivalDistances.assign(Inventory::COUNT, UNREACHABLE);
+    rivalQueue.resize(Inventory::COUNT);
+    rivalBrewTurns.fill(UNREACHABLE);
+
+    int head = 0, tail = 0;
+    inv_t start = Inventory::index(opponent.inv);
+    rivalDistances[start] = 0;
+    rivalQueue[tail++] = start;
+
+    while (head < tail) {
+        inv_t inv = rivalQueue[head++];
+        const Delta& from = Inventory::delta(inv);
+        for (int i = 0; i < orderCount; ++i)
+            if (rivalBrewTurns[i] == UNREACHABLE && from.canApply(orders[i].delta))
+                rivalBrewTurns[i] = rivalDistances[inv] + 1;
+
+        if (rivalDistances[inv] + 2 >= UNREACHABLE)
+            continue;
+        for (int i = 0; i < opponentSpellCount; ++i)
+            for (int j = 0; j < opponentSpells[i].maxTimes; ++j) {
+                const Delta& delta = opponentSpells[i].repeatedDeltas[j];
+                if (!from.canApply(delta))
+                    break;
+                inv_t next = Inventory::index(from + delta);
+                if (rivalDistances[next] == UNREACHABLE) {
+                    rivalDistances[next] = rivalDistances[inv] + 1;
+                    rivalQueue[tail++] = next;
+                }
+            }
+    }
+}
+
+State SearchEngine::getInitialState() const {
+    State initialState;
+    initialState.inv = Inventory::index(player.inv);
+    initialState.score = 0;
+
+    initialState.castableSpellsMask = 0;
+    for (int i = 0; i < spellCount; ++i)
+        if (spells[i].castable)
+            initialState.castableSpellsMask |= 1 << i;
+
+    initialState.ordersTodoMask = (1 << orderCount) - 1;
+    initialState.recipesTodoMask = (1 << recipeCount) - 1;
+    initialState.castableSpellsFromRecipesMask = (1 << recipeCount) - 1;
+    initialState.gamma = 1.f;
+
+    initialState.evaluation = rootEvaluation(initialState);
+    initialState.discounted = 0;
+
+    initialState.ordersDone = playerOrdersDone;
+    initialState.recipesLearnt = recipeDoneCount;
+    initialState.firstAction = NO_ACTION;
+    initialState.secondAction = NO_ACTION;
+    initialState.depth = 0;
+
+    return initialState;
+}
+
+eval_t SearchEngine::rootEvaluation(const State& s) const {
+    return Inventory::eval(s.inv) + __builtin_popcount(s.castableSpellsMask) * params.castableValue;
+}
+
+std::string SearchEngine::describe(const State& s) const {
+    std::ostringstream out;
+    out << "inv=" << Inventory::delta(s.inv) << ", score=" << s.score << "\n";
+    out << "gamma=" << s.gamma << "\n";
+    out << "evaluation=" << s.evaluation << "\n";
+    out << "ordersDone=" << s.ordersDone << "\n";
+    out << "recipesLearnt=" << s.recipesLearnt << "\n";
+
+    out << "SPELLS:\n";
+    for (int i = 0; i < spellCount; ++i) {
+        out << "\t" << (s.isCastable(i) ? "CASTABLE" : "NONCASTABLE") << " ";
+        out << spells[i] << "\n";
+    }
+
+    out << "ORDERS:\n";
+    for (int i = 0; i < orderCount; ++i) {
+        out << "\t" << (s.isOrderDoable(i) ? "DOABLE" : "DONE") << " ";
+        out << orders[i] << "\n";
+    }
+
+    out << "RECIPES:\n";
+    for (int i = 0; i < recipeCount; ++i) {
+        out << "\t" << (s.isRecipeDoable(i) ? "DOABLE" : "DONE") << " ";
+        out << recipes[i] << "\n";
+    }
+
+    return out.str();
+}
@@ -0,0 +1,354 @@
+#ifndef SEARCH_ENGINE_HPP
+#define SEARCH_ENGINE_HPP
+
+#include "Delta.hpp"
+#include "DeltaBatch.hpp"
+#include "Action.hpp"
+#include "Common.hpp"
+#include "Inventory.hpp"
+#include "Options.hpp"
+#include "Snapshot.hpp"
+#include "TranspositionTable.hpp"
+#include "WorkerPool.hpp"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct State;
+class Beam;
+class Mcts;
+
+using action_id_t = uint8_t;
+
+struct SearchStats {
+    int depth = 0;
+    int width = 0;
+    int seeded = 0;
+    long long expanded = 0;
+    long long generated = 0;
+    long long duplicates = 0;
+    bool aborted = false;
+    float time = 0;
+    float overshoot = 0;
+    std::vector<float> layerTimes;
+    std::vector<int> layerDuplicates;
+
+    void reset();
+};
+
+struct MctsStats {
+    long long iterations = 0;
+    int nodes = 0;
+    int depth = 0;
+    int reused = 0;
+    float time = 0;
+    float overshoot = 0;
+    // SearchEngine::NO_ACTION
+    action_id_t firstAction = UINT8_MAX;
+
+    void reset();
+};
+
+// The action is one of the engine's and stays valid until its next turn.
+// Only the stats of the engine that searched are filled.
+struct Decision {
+    const Action* action = nullptr;
+    SearchStats search;
+    MctsStats mcts;
+};
+
+// Plays one side of one game: besides its buffers, an engine keeps what
+// it learns about the game from turn to turn, so it is given every turn
+// of that game in order, and newGame() before the next one. Engines share
+// nothing, so each can play on a thread of its own.
+class SearchEngine {
+    friend class Bench;
+    friend class Mcts;
+
+public:
+    SearchEngine();
+    SearchEngine(const SearchEngine&) = delete;
+    SearchEngine& operator=(const SearchEngine&) = delete;
+    ~SearchEngine();
+
+    // received is when the turn's input arrived, which the referee's
+    // clock counts from.
+    Decision decide(const Snapshot& snapshot,
+        const Timer::Clock::time_point& received = Timer::Clock::now());
+    // Logs how decision was reached. Called once its action is out, as
+    // DEBUG builds, the merged submission among them, would otherwise
+    // format all of it on the turn's clock.
+    void report(const Decision& decision) const;
+    void newGame();
+    // Derives the tables of params; beamWidth is taken from them too.
+    void setParams(const Options::Params& params);
+
+private:
+    void load(const Snapshot& snapshot);
+    void buildTables();
+    #ifdef DEBUG
+    void writeData() const;
+    #endif
+    const Action* pickAction(const Timer::Clock::time_point& received);
+    const Action* chooseRecipe();
+    const Action* search(float timeLimit, int maxDepth = INF);
+    const Action* search(const Timer& timer, int maxDepth = INF);
+    State getInitialState() const;
+    // What a search rooted at s starts its evaluation from.
+    eval_t rootEvaluation(const State& s) const;
+    std::string describe(const State& s) const;
+    void buildActionTable();
+    void buildTransitions();
+    void buildOrderDistances();
+    void buildRivalBrewTurns();
+    void reserveBuffers();
+    int takeSeeds(const State& root);
+    // Turns s, on a line through next, into the state a search rooted at
+    // next reaches, whose root evaluation is nextRootEvaluation: a move
+    // shallower, with what gamma weighed scaled back by one decay.
+    void reroot(State& s, const State& next, const eval_t& nextRootEvaluation) const;
+    void carryOver(const State& root, const Beam& layer, const int& count,
+        const action_id_t& action);
+    bool expand(const Beam& parents, const int& parentCount, Beam& children,
+        const Timer* timer);
+    int removeDuplicates(const Beam& states, const Timer* timer);
+    MULTIVERSION int selectBest(const Beam& states, const int& stateCount, Beam& selected,
+        const Timer* timer);
+
+public:
+    int spellCount;
+    int orderCount;
+    int recipeCount;
+
+    static constexpr int MAX_SPELL_COUNT = 20;
+    static constexpr int MAX_ORDER_COUNT = 5;
+    static constexpr int MAX_RECIPE_COUNT = 6;
+
+    std::array<Spell, MAX_SPELL_COUNT> spells;
+    std::array<Order, MAX_ORDER_COUNT> orders;
+    std::array<Recipe, MAX_RECIPE_COUNT> recipes;
+    std::array<Spell, MAX_RECIPE_COUNT> spellsFromRecipes;
+    Rest rest;
+
+    // The opponent's spells never enter a state key, and it may learn the
+    // whole tome: its 42 recipes on top of the 4 starting spells.
+    static constexpr int MAX_OPPONENT_SPELL_COUNT = 46;
+
+    int opponentSpellCount;
+    std::array<Spell, MAX_OPPONENT_SPELL_COUNT> opponentSpells;
+
+    // Every action the root can take, addressed by the small id states keep
+    // as their first action: orders, then recipes, then rest, then each
+    // spell cast 1..maxTimes times, in the order of their cast slots.
+    static constexpr int MAX_CAST_COUNT = MAX_SPELL_COUNT * Spell::MAX_REPEATED_DELTA;
+    static constexpr int REST_ACTION = MAX_ORDER_COUNT + MAX_RECIPE_COUNT;
+    static constexpr int FIRST_CAST_ACTION = REST_ACTION + 1;
+    static constexpr int MAX_ACTION_COUNT = FIRST_CAST_ACTION + MAX_CAST_COUNT;
+    static constexpr action_id_t NO_ACTION = UINT8_MAX;
+    // a move with no id this turn, like casting a spell learnt on the way
+    static constexpr action_id_t UNKNOWN_ACTION = NO_ACTION - 1;
+    // the first action of every MCTS state, whose second is the move into it
+    static constexpr action_id_t TREE_ACTION = UNKNOWN_ACTION - 1;
+    static_assert(MAX_ACTION_COUNT <= TREE_ACTION, "action ids don't fit action_id_t");
+
+    std::array<const Action*, MAX_ACTION_COUNT> actions;
+    std::array<Spell, MAX_CAST_COUNT> casts;
+
+    // Inventory reached from every inventory by every cast and order this
+    // turn, or Inventory::NONE when it can't be afforded. A row holds the
+    // casts of spells (spell i cast j + 1 times is at spellCastSlots[i] + j),
+    // then those of spells from recipes, then the orders. slotDeltas holds
+    // the delta of every slot, and slotBatch the same for testing them all
+    // against an inventory at once.
+    std::vector<Delta> slotDeltas;
+    DeltaBatch slotBatch;
+    std::vector<inv_t> transitions;
+    int transitionStride;
+    int orderSlot;
+    std::array<int, MAX_SPELL_COUNT> spellCastSlots;
+    std::array<int, MAX_RECIPE_COUNT> recipeCastSlots;
+
+    int maxNeighbors;
+
+    inline const inv_t* transitionRow(const inv_t& inv) const;
+
+    // Fewest casts that take an inventory to one affording each order, with
+    // this turn's spells and ignoring the rests exhaustion would force, so
+    // a lower bound on the turns needed. UNREACHABLE if no cast sequence
+    // gets there.
+    static constexpr uint8_t UNREACHABLE = UINT8_MAX;
+    std::vector<uint8_t> orderDistances;
+
+    inline uint8_t orderDistance(const inv_t& inv, const int& order) const;
+
+    // Earliest turn, counting the brew itself, the opponent could brew each
+    // order using its current spells and ignoring rests. Orders we'd brew
+    // later than that are likely gone by then and get discounted by
+    // Options::Params::rivalDiscount.
+    std::array<uint8_t, MAX_ORDER_COUNT> rivalBrewTurns;
+
+    // Orders done so far, counted from changes of score between turns.
+    int playerOrdersDone;
+    int enemyOrdersDone;
+    int lastPlayerScore;
+    int lastEnemyScore;
+
+    Witch player;
+    Witch opponent;
+
+    // The game ends after MAX_ROUNDS rounds, so no line is searched past
+    // the rounds left; State::depth and the rival's brew turns count up
+    // to it.
+    static constexpr int MAX_ROUNDS = 100;
+    int roundNumber;
+    int recipeDoneCount;
+    int roundsLeft() const;
+
+    enum class Engine {
+        BEAM,
+        MCTS
+    };
+    Engine engine;
+
+    Options::Params params;
+    // params differ from Options::DEFAULTS where Compiled would fix them
+    bool tuned;
+
+    int beamWidth;
+    int threadCount;
+    static constexpr int MIN_PARENTS_PER_THREAD = 64;
+    static constexpr int TIME_CHECK_INTERVAL = 256;
+
+    float firstTurnTimeLimit;
+    float turnTimeLimit;
+    // Taken off the turn limit for printing the action and flushing the
+    // log, and four times that off the first turn's; never more than a
+    // quarter of either.
+    float deadlineMargin;
+
+    // Children of one layer, as [begin, begin + count) runs of the buffer
+    // they were generated into, one per worker.
+    struct Slice {
+        int begin;
+        int count;
+    };
+    std::vector<Slice> slices;
+    WorkerPool workers;
+
+    struct Candidate {
+        eval_t evaluation;
+        int index;
+
+        bool operator>(const Candidate& c) const {
+            return evaluation > c.evaluation;
+        }
+    };
+
+    // Search buffers, sized for beamWidth * maxNeighbors states before the
+    // clock starts so no layer has to allocate.
+    static constexpr int LAYER_COUNT = 2;
+    std::unique_ptr<Beam[]> layers;
+    TranspositionTable transpositions;
+    std::vector<int> survivors;
+    std::vector<Candidate> candidates;
+
+    // The last layer of the previous search, cut down to the states behind
+    // the move that was played and re-rooted one move later. It's merged
+    // into the layer of the same depth if this turn's root is the state
+    // that move was expected to reach, under the same spells, orders and
+    // recipes. Off in the bench unless asked for, as frames there needn't
+    // follow each other.
+    bool reuseSearch;
+    std::vector<State> carried;
+    std::vector<State> carriedNext;
+    uint64_t carriedSignature;
+    uint64_t carriedKey;
+
+    uint64_t tableSignature() const;
+
+    SearchStats stats;
+    std::unique_ptr<Mcts> mcts;
+    // the leaf the last beam search took its move from, for report()
+    std::unique_ptr<State> bestLeaf;
+
+    // scratch space of the per-turn tables
+    std::vector<uint64_t> applicable;
+    std::vector<int> predecessorBegin;
+    std::vector<int> predecessorEnd;
+    std::vector<int> predecessors;
+    std::vector<inv_t> orderQueue;
+    std::vector<uint8_t> rivalDistances;
+    std::vector<inv_t> rivalQueue;
+};
+
+struct State {
+    inv_t inv;
+    // the first two moves of the line that led here, from the root
+    action_id_t firstAction;
+    action_id_t secondAction;
+    int score;
+    int castableSpellsMask;
+    int ordersTodoMask;
+    int recipesTodoMask;
+    int castableSpellsFromRecipesMask;
+    float gamma;
+    eval_t evaluation;
+    // the part of evaluation weighted by gamma: orders and recipes
+    eval_t discounted;
+    int ordersDone;
+    int recipesLearnt;
+    uint16_t depth;
+
+    inline void recordAction(const action_id_t& action);
+    uint64_t key() const;
+    // Both use the compiled parameters unless the engine's were tuned.
+    eval_t leafEvaluation(const SearchEngine& engine) const;
+    int getNeighbors(const SearchEngine& engine, State* neighbors) const;
+
+    // P is Options::Compiled or Options::Runtime.
+    template<typename P> eval_t evaluateLeaf(const SearchEngine& engine) const;
+    template<typename P> int generateNeighbors(const SearchEngine& engine,
+        State* neighbors) const;
+    template<typename P> void getSpellActions(const SearchEngine& engine,
+        State* neighbors, int& neighborCount) const;
+    template<typename P> void castSpell(const SearchEngine& engine, const int& i,
+        State* neighbors, int& neighborCount) const;
+    template<typename P> void getOrderActions(const SearchEngine& engine,
+        State* neighbors, int& neighborCount) const;
+    template<typename P> void brewOrder(const SearchEngine& engine, const int& i,
+        const inv_t* next, State* neighbors, int& neighborCount) const;
+    template<typename P> void getRecipeActions(const SearchEngine& engine,
+        State* neighbors, int& neighborCount) const;
+    template<typename P> void useRecipe(const SearchEngine& engine, const int& i,
+        const bool& canLearn, State* neighbors, int& neighborCount) const;
+    template<typename P> void getRestAction(const SearchEngine& engine,
+        State* neighbors, int& neighborCount) const;
+
+    bool isCastable(const int& i) const;
+    bool isOrderDoable(const int& i) const;
+    bool isRecipeDoable(const int& i) const;
+
+    bool operator<(const State& s) const;
+    bool operator>(const State& s) const;
+};
+
+const inv_t* SearchEngine::transitionRow(const inv_t& inv) const {
+    return transitions.data() + inv * transitionStride;
+}
+
+// Called on a copy of the parent, so the fields still hold its line.
+void State::recordAction(const action_id_t& action) {
+    if (firstAction == SearchEngine::NO_ACTION)
+        firstAction = action;
+    else if (secondAction == SearchEngine::NO_ACTION)
+        secondAction = action;
+}
+
+uint8_t SearchEngine::orderDistance(const inv_t& inv, const int& order) const {
+    return orderDistances[inv * MAX_ORDER_COUNT + order];
+}
+
+#endif /* SEARCH_ENGINE_HPP */
@@ -0,0 +1,51 @@
+#include "Snapshot.hpp"
+#include "Stats.hpp"
+
+#include <cassert>
+
+void Snapshot::read(Reader& in) {
+    STATS_TIME(PARSE);
+    auto readDelta = [&in] {
+        int d0 = in.readInt(), d1 = in.readInt();
+        int d2 = in.readInt(), d3 = in.readInt();
+        return Delta(d0, d1, d2, d3);
+    };
+
+    orders.clear();
+    recipes.clear();
+    spells.clear();
+    opponentSpells.clear();
+
+    int actionCount = in.readInt();
+    while (actionCount--) {
+        int actionId = in.readInt();
+        char actionType = in.readKeyword();
+        Delta delta = readDelta();
+
+        int price = in.readInt();
+        int tomeIndex = in.readInt();
+        int taxCount = in.readInt();
+        bool castable = in.readInt();
+        bool repeatable = in.readInt();
+
+        switch (actionType) {
+            case 'B': // BREW
+                orders.emplace_back(actionId, delta, price);
+                break;
+            case 'C': // CAST
+                spells.emplace_back(actionId, delta, castable, repeatable);
+                break;
+            case 'L': // LEARN
+                recipes.emplace_back(actionId, delta, tomeIndex, taxCount, repeatable);
+                break;
+            default:
+                assert(actionType == 'O'); // OPPONENT_CAST
+                opponentSpells.emplace_back(actionId, delta, castable, repeatable);
+        }
+    }
+
+    player.inv = readDelta();
+    player.score = in.readInt();
+    opponent.inv = readDelta();
+    opponent.score = in.readInt();
+}
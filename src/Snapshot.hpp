@@ -0,0 +1,23 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include "Action.hpp"
+#include "Reader.hpp"
+
+#include <vector>
+
+// One turn of the game as the referee describes it, in the order it lists
+// the actions.
+struct Snapshot {
+    std::vector<Order> orders;
+    std::vector<Recipe> recipes;
+    std::vector<Spell> spells;
+    std::vector<Spell> opponentSpells;
+    Witch player;
+    Witch opponent;
+
+    // Reads the next frame, keeping the vectors' capacity.
+    void read(Reader& in);
+};
+
+#endif /* SNAPSHOT_HPP */
@@ -0,0 +1,74 @@
+#include "Stats.hpp"
+#include "Log.hpp"
+
+#ifdef STATS
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace {
+    std::mutex mutex;
+    std::vector<Stats::Counters*> threads;
+    // left behind by threads that have ended since the last collect()
+    Stats::Counters retired;
+
+    struct Registration {
+        Stats::Counters counters;
+
+        Registration() {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.push_back(&counters);
+        }
+
+        ~Registration() {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.erase(std::find(threads.begin(), threads.end(), &counters));
+            retired += counters;
+        }
+    };
+
+    double perCall(const uint64_t& ns, const uint64_t& calls) {
+        return calls ? double(ns) / calls : 0;
+    }
+}
+
+Stats::Counters& Stats::Counters::operator+=(const Counters& o) {
+    for (int i = 0; i < COUNTER_COUNT; ++i)
+        counts[i] += o.counts[i];
+    for (int i = 0; i < PHASE_COUNT; ++i)
+        ns[i] += o.ns[i];
+    return *this;
+}
+
+Stats::Counters& Stats::local() {
+    thread_local Registration registration;
+    return registration.counters;
+}
+
+Stats::Counters Stats::collect() {
+    std::lock_guard<std::mutex> lock(mutex);
+    Counters total = retired;
+    retired = Counters();
+    for (Counters* counters : threads) {
+        total += *counters;
+        *counters = Counters();
+    }
+    return total;
+}
+
+void Stats::report(const int& round, const long long& expanded, const int& depth) {
+    Counters c = collect();
+    char line[Log::SLOT_SIZE];
+    int length = std::snprintf(line, sizeof(line), "stats %d: expanded %lld depth %d | "
+        "neighbors %llu calls %llu states %.0f ns/call | select %llu %.0f ns/call | legality %llu | parse %llu ns\n",
+        round, expanded, depth,
+        (unsigned long long)c.counts[NEIGHBOR_CALLS], (unsigned long long)c.counts[NEIGHBORS],
+        perCall(c.ns[EXPAND], c.counts[NEIGHBOR_CALLS]),
+        (unsigned long long)c.counts[SELECTIONS], perCall(c.ns[SELECT], c.counts[SELECTIONS]),
+        (unsigned long long)c.counts[LEGALITY_CHECKS], (unsigned long long)c.ns[PARSE]);
+    Log::append(line, std::min(size_t(length), sizeof(line) - 1));
+}
+
+#endif
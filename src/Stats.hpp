@@ -0,0 +1,73 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <chrono>
+#include <cstdint>
+
+// Counters and scoped timers on the hot paths, only built in with -DSTATS
+// (make stats). Anywhere else STATS_COUNT and STATS_TIME expand to
+// nothing, so release code doesn't pay for them.
+//
+// Every thread counts into its own slots; collect() adds up and clears
+// those of all threads, so it must run while no search does, between two
+// turns.
+namespace Stats {
+    enum Counter {
+        NEIGHBOR_CALLS,
+        NEIGHBORS,
+        LEGALITY_CHECKS,
+        SELECTIONS,
+        COUNTER_COUNT
+    };
+
+    enum Phase {
+        PARSE,
+        EXPAND,
+        SELECT,
+        PHASE_COUNT
+    };
+
+#ifdef STATS
+    struct Counters {
+        uint64_t counts[COUNTER_COUNT] = {};
+        uint64_t ns[PHASE_COUNT] = {};
+
+        Counters& operator+=(const Counters& o);
+    };
+
+    Counters& local();
+    Counters collect();
+    // One line to the log: the search totals given and every counter.
+    void report(const int& round, const long long& expanded, const int& depth);
+
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(const Phase& phase) :
+            phase(phase), start(std::chrono::steady_clock::now()) {
+
+        }
+
+        ~ScopedTimer() {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start);
+            local().ns[phase] += ns.count();
+        }
+
+    private:
+        Phase phase;
+        std::chrono::time_point<std::chrono::steady_clock> start;
+    };
+#endif
+}
+
+#ifdef STATS
+#define STATS_CONCAT_(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_(a, b)
+#define STATS_COUNT(counter, n) (Stats::local().counts[Stats::counter] += (n))
+#define STATS_TIME(phase) Stats::ScopedTimer STATS_CONCAT(statsTimer, __LINE__)(Stats::phase)
+#else
+#define STATS_COUNT(counter, n) ((void)0)
+#define STATS_TIME(phase) ((void)0)
+#endif
+
+#endif /* STATS_HPP */
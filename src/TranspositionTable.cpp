@@ -0,0 +1,23 @@
+#include "TranspositionTable.hpp"
+
+#include <algorithm>
+
+void TranspositionTable::reserve(const int& size) {
+    int capacityLog = 4;
+    while ((size_t(1) << capacityLog) < 2 * size_t(size))
+        ++capacityLog;
+    if ((size_t(1) << capacityLog) <= entries.size())
+        return;
+
+    entries.assign(size_t(1) << capacityLog, Entry{0, 0, 0});
+    mask = (uint64_t(1) << capacityLog) - 1;
+    shift = 64 - capacityLog;
+    generation = 1;
+}
+
+void TranspositionTable::clear() {
+    if (++generation == 0) {
+        std::fill(entries.begin(), entries.end(), Entry{0, 0, 0});
+        generation = 1;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef TRANSPOSITION_TABLE_HPP
+#define TRANSPOSITION_TABLE_HPP
+
+#include <cstdint>
+#include <vector>
+
+// Open-addressing map from a state key to the index of the state kept for
+// it in the current beam layer. Entries are tagged with a generation
+// number, so starting a new layer doesn't need to clear the table.
+class TranspositionTable {
+public:
+    // Makes room for at least size keys at a load factor of at most 1/2.
+    void reserve(const int& size);
+    void clear();
+    // Returns the index stored for key, or stores index and returns -1.
+    inline int findOrInsert(const uint64_t& key, const int& index);
+
+private:
+    struct Entry {
+        uint64_t key;
+        uint32_t generation;
+        int index;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t mask = 0;
+    int shift = 64;
+    uint32_t generation = 1;
+};
+
+int TranspositionTable::findOrInsert(const uint64_t& key, const int& index) {
+    uint64_t pos = (key * 0x9e3779b97f4a7c15ull) >> shift;
+    while (true) {
+        auto& entry = entries[pos];
+        if (entry.generation != generation) {
+            entry.key = key;
+            entry.generation = generation;
+            entry.index = index;
+            return -1;
+        }
+        if (entry.key == key)
+            return entry.index;
+        pos = (pos + 1) & mask;
+    }
+}
+
+#endif /* TRANSPOSITION_TABLE_HPP */
@@ -0,0 +1,69 @@
+#include "WorkerPool.hpp"
+
+#include <cassert>
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+void WorkerPool::resize(const int& workerCount) {
+    assert(workerCount >= 1);
+    if (workerCount == size())
+        return;
+
+    stop();
+    stopping = false;
+    for (int worker = 1; worker < workerCount; ++worker)
+        threads.emplace_back(&WorkerPool::work, this, worker, round);
+}
+
+int WorkerPool::size() const {
+    return int(threads.size()) + 1;
+}
+
+void WorkerPool::run(const std::function<void(int)>& job) {
+    if (!threads.empty()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->job = &job;
+        pending = int(threads.size());
+        ++round;
+    }
+    wake.notify_all();
+
+    job(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return pending == 0; });
+}
+
+void WorkerPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto& thread : threads)
+        thread.join();
+    threads.clear();
+}
+
+void WorkerPool::work(const int& worker, uint64_t seen) {
+    while (true) {
+        const std::function<void(int)>* task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || round != seen; });
+            if (stopping)
+                return;
+            seen = round;
+            task = job;
+        }
+
+        (*task)(worker);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0)
+            done.notify_one();
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads that run the same job side by side. The thread
+// calling run() takes part as worker 0, so a pool of size 1 has no
+// threads at all.
+class WorkerPool {
+public:
+    WorkerPool() = default;
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    ~WorkerPool();
+
+    void resize(const int& workerCount);
+    int size() const;
+
+    // Calls job(worker) once for every worker and waits for all of them.
+    void run(const std::function<void(int)>& job);
+
+private:
+    void stop();
+    void work(const int& worker, uint64_t seen);
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(int)>* job = nullptr;
+    uint64_t round = 0;
+    int pending = 0;
+    bool stopping = false;
+};
+
+#endif /* WORKER_POOL_HPP */
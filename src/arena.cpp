@@ -0,0 +1,370 @@
+#include "Referee.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// An agent run by /bin/sh -c in a child process, reading its frames from
+// one pipe and answering on another, its stderr thrown away.
+class Agent {
+public:
+    Agent() = default;
+    Agent(const Agent&) = delete;
+    Agent& operator=(const Agent&) = delete;
+
+    ~Agent() {
+        stop();
+    }
+
+    bool start(const std::string& command) {
+        // Close-on-exec, so agents of games started at the same time on
+        // other threads don't inherit these ends and keep them open.
+        int toChild[2], fromChild[2];
+        if (pipe2(toChild, O_CLOEXEC))
+            return false;
+        if (pipe2(fromChild, O_CLOEXEC)) {
+            close(toChild[0]);
+            close(toChild[1]);
+            return false;
+        }
+
+        pid = fork();
+        if (pid == 0) {
+            dup2(toChild[0], STDIN_FILENO);
+            dup2(fromChild[1], STDOUT_FILENO);
+            int null = open("/dev/null", O_WRONLY);
+            if (null != -1)
+                dup2(null, STDERR_FILENO);
+            execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char*>(nullptr));
+            _exit(127);
+        }
+
+        close(toChild[0]);
+        close(fromChild[1]);
+        in = toChild[1];
+        out = fromChild[0];
+        if (pid == -1) {
+            stop();
+            return false;
+        }
+        return true;
+    }
+
+    bool send(const std::string& text) {
+        for (size_t written = 0; written < text.size(); ) {
+            ssize_t count = write(in, text.data() + written, text.size() - written);
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                return false;
+            written += count;
+        }
+        return true;
+    }
+
+    // Waits at most timeout ms for the next line of output.
+    bool receive(std::string& line, const float& timeout) {
+        Timer timer(timeout);
+        while (true) {
+            size_t newline = pending.find('\n');
+            if (newline != std::string::npos) {
+                line = pending.substr(0, newline);
+                pending.erase(0, newline + 1);
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                return true;
+            }
+
+            int left = int(std::ceil(timeout - timer.elapsed()));
+            if (left <= 0)
+                return false;
+            pollfd p = { out, POLLIN, 0 };
+            int ready = poll(&p, 1, left);
+            if (ready < 0 && errno == EINTR)
+                continue;
+            if (ready <= 0)
+                return false;
+
+            char buffer[4096];
+            ssize_t count = read(out, buffer, sizeof(buffer));
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                return false;
+            pending.append(buffer, count);
+        }
+    }
+
+    // Closing stdin ends the agent's input loop; one still thinking after
+    // a timeout gets a moment more and is then killed.
+    void stop() {
+        if (in != -1)
+            close(in);
+        if (pid > 0) {
+            Timer timer(STOP_GRACE);
+            while (waitpid(pid, nullptr, WNOHANG) == 0) {
+                if (!timer.isTimeLeft()) {
+                    kill(pid, SIGKILL);
+                    waitpid(pid, nullptr, 0);
+                    break;
+                }
+                usleep(1000);
+            }
+        }
+        if (out != -1)
+            close(out);
+        in = out = pid = -1;
+        pending.clear();
+    }
+
+private:
+    static constexpr float STOP_GRACE = 500;
+
+    pid_t pid = -1;
+    int in = -1;
+    int out = -1;
+    std::string pending;
+};
+
+// Plays two agents against each other on the local referee. Every seed is
+// played twice, the agents swapping sides, and games run on several
+// threads at once.
+class Arena {
+public:
+    static int run(int argc, char* argv[]);
+
+private:
+    static constexpr int AGENT_COUNT = 2;
+    static constexpr float FIRST_TURN_LIMIT = 1000;
+    static constexpr float TURN_LIMIT = 50;
+
+    struct Config {
+        std::string commands[AGENT_COUNT];
+        int games = 100;
+        int threads = 1;
+        uint32_t seed = 1;
+        float timeout = 2000;
+        bool verbose = false;
+    };
+
+    // Everything below is per agent, not per side of the table.
+    struct Game {
+        uint32_t seed = 0;
+        int rounds = 0;
+        // of the first agent: 1 won, 0 lost, -1 draw
+        int result = -1;
+        int scores[AGENT_COUNT] = {};
+        bool disqualified[AGENT_COUNT] = {};
+        std::string errors[AGENT_COUNT];
+        float firstTurn[AGENT_COUNT] = {};
+        std::vector<float> turns[AGENT_COUNT];
+    };
+
+    static void play(const Config& config, const int& index, Game& game);
+    static void report(const Config& config, const std::vector<Game>& games, const float& time);
+    static float percentile(std::vector<float> values, float p);
+    static void usage(const char* name);
+};
+
+void Arena::usage(const char* name) {
+    std::cerr << "usage: " << name << " [-g games] [-j threads] [-s seed] [-k ms] [-v] agent agent\n"
+              << "  agent        command run by /bin/sh -c, e.g. \"./witch-battle -t 40\"\n"
+              << "  -g games     games to play, each seed from both sides (default 100)\n"
+              << "  -j threads   games played at once (default 1)\n"
+              << "  -s seed      seed of the first game (default 1)\n"
+              << "  -k ms        an agent silent this long loses the game (default 2000)\n"
+              << "  -v           print the result of every game\n"
+              << "exits with 1 if either agent lost a game on an error\n";
+}
+
+float Arena::percentile(std::vector<float> values, float p) {
+    if (values.empty())
+        return 0;
+    size_t k = std::min(values.size() - 1, size_t(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+// The agents are asked one after the other, so neither is timed while the
+// other one searches. Both see the state from before the round either way.
+void Arena::play(const Config& config, const int& index, Game& game) {
+    game.seed = config.seed + index / 2;
+    Referee referee(game.seed);
+
+    int agentOf[Referee::PLAYER_COUNT] = { index % 2, 1 - index % 2 };
+    Agent agents[Referee::PLAYER_COUNT];
+    for (int p = 0; p < Referee::PLAYER_COUNT; ++p)
+        if (!agents[p].start(config.commands[agentOf[p]]))
+            referee.forfeit(p, "cannot start");
+
+    while (!referee.isOver()) {
+        std::string lines[Referee::PLAYER_COUNT];
+        for (int p = 0; p < Referee::PLAYER_COUNT && !referee.isOver(); ++p) {
+            Timer timer(0);
+            if (!agents[p].send(referee.frame(p)) || !agents[p].receive(lines[p], config.timeout)) {
+                referee.forfeit(p, "no answer in round " + std::to_string(referee.round()));
+                break;
+            }
+
+            float latency = timer.elapsed();
+            int agent = agentOf[p];
+            if (referee.round() == 0)
+                game.firstTurn[agent] = latency;
+            else
+                game.turns[agent].push_back(latency);
+        }
+
+        if (!referee.isOver())
+            referee.play(lines);
+    }
+
+    game.rounds = referee.round();
+    for (int p = 0; p < Referee::PLAYER_COUNT; ++p) {
+        int agent = agentOf[p];
+        game.scores[agent] = referee.finalScore(p);
+        game.disqualified[agent] = referee.isDisqualified(p);
+        game.errors[agent] = referee.error(p);
+    }
+    game.result = referee.result(index % 2);
+}
+
+void Arena::report(const Config& config, const std::vector<Game>& games, const float& time) {
+    int n = int(games.size());
+    int wins = 0, losses = 0, draws = 0;
+    long long rounds = 0;
+    for (const auto& game : games) {
+        wins += game.result == 1;
+        losses += game.result == 0;
+        draws += game.result == -1;
+        rounds += game.rounds;
+    }
+
+    // draws count as half a win; the margin is a normal 95% interval
+    double rate = (wins + draws / 2.0) / n;
+    double margin = 1.96 * std::sqrt(rate * (1 - rate) / n);
+    std::printf("games: %d, seeds %u..%u, %.1f s, %.2f games/s, mean rounds %.1f\n",
+        n, config.seed, config.seed + (n - 1) / 2, time / 1000, n / (time / 1000),
+        double(rounds) / n);
+    std::printf("first agent: %d wins, %d losses, %d draws, win rate %.1f%% +- %.1f%%\n\n",
+        wins, losses, draws, 100 * rate, 100 * margin);
+
+    std::printf("%-5s %7s %5s %9s %9s %9s %9s %9s %9s %6s  command\n", "agent", "score",
+        "lost", "first ms", "first max", "mean ms", "p50", "p99", "max", "late");
+    for (int agent = 0; agent < AGENT_COUNT; ++agent) {
+        std::vector<float> turns, firstTurns;
+        long long score = 0;
+        int disqualified = 0, late = 0;
+        for (const auto& game : games) {
+            score += game.scores[agent];
+            disqualified += game.disqualified[agent];
+            firstTurns.push_back(game.firstTurn[agent]);
+            late += game.firstTurn[agent] > FIRST_TURN_LIMIT;
+            for (const float& t : game.turns[agent]) {
+                turns.push_back(t);
+                late += t > TURN_LIMIT;
+            }
+        }
+
+        double mean = 0, firstMean = 0;
+        for (const float& t : turns)
+            mean += t;
+        for (const float& t : firstTurns)
+            firstMean += t;
+        std::printf("%-5c %7.1f %5d %9.2f %9.2f %9.3f %9.3f %9.3f %9.3f %6d  %s\n", 'A' + agent,
+            double(score) / n, disqualified, firstMean / n,
+            *std::max_element(firstTurns.begin(), firstTurns.end()),
+            turns.empty() ? 0 : mean / turns.size(), percentile(turns, 0.5f),
+            percentile(turns, 0.99f), turns.empty() ? 0 : percentile(turns, 1),
+            late, config.commands[agent].c_str());
+    }
+
+    for (int agent = 0; agent < AGENT_COUNT; ++agent)
+        for (const auto& game : games)
+            if (game.disqualified[agent]) {
+                std::printf("\n%c lost seed %u on: %s\n", 'A' + agent, game.seed,
+                    game.errors[agent].c_str());
+                break;
+            }
+}
+
+int Arena::run(int argc, char* argv[]) {
+    Config config;
+    int agentCount = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "-g") && i + 1 < argc)
+            config.games = std::max(1, std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "-j") && i + 1 < argc)
+            config.threads = std::max(1, std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "-s") && i + 1 < argc)
+            config.seed = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+        else if (!std::strcmp(argv[i], "-k") && i + 1 < argc)
+            config.timeout = std::max(1.f, float(std::atof(argv[++i])));
+        else if (!std::strcmp(argv[i], "-v"))
+            config.verbose = true;
+        else if (argv[i][0] == '-' || agentCount == AGENT_COUNT) {
+            usage(argv[0]);
+            return 1;
+        }
+        else
+            config.commands[agentCount++] = argv[i];
+    }
+
+    if (agentCount != AGENT_COUNT) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // an agent that dies shows up as a failed write, not a signal
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::vector<Game> games(config.games);
+    std::atomic<int> next(0);
+    std::mutex output;
+    Timer timer(0);
+
+    auto worker = [&]() {
+        for (int i = next++; i < config.games; i = next++) {
+            play(config, i, games[i]);
+            if (config.verbose) {
+                std::lock_guard<std::mutex> lock(output);
+                const Game& g = games[i];
+                std::printf("game %d, seed %u, A as player %d: %d - %d in %d rounds%s\n", i,
+                    g.seed, i % 2, g.scores[0], g.scores[1], g.rounds,
+                    g.disqualified[0] || g.disqualified[1] ? ", disqualified" : "");
+                std::fflush(stdout);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < config.threads; ++t)
+        threads.emplace_back(worker);
+    for (auto& thread : threads)
+        thread.join();
+
+    report(config, games, timer.elapsed());
+    // a crash, timeout or illegal move fails the run, for scripts
+    bool faulted = std::any_of(games.begin(), games.end(),
+        [](const Game& game) { return game.disqualified[0] || game.disqualified[1]; });
+    return faulted ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+    return Arena::run(argc, argv);
+}
@@ -0,0 +1,828 @@
+#include "SearchEngine.hpp"
+#include "Beam.hpp"
+#include "Mcts.hpp"
+#include "Options.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+// Counts hardware events of this thread while enabled, through
+// perf_event_open(). Without access to the counters (containers, VMs
+// without a PMU, perf_event_paranoid) it stays unavailable and reads 0.
+class PerfCounter {
+public:
+    PerfCounter(const uint32_t& type, const uint64_t& config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    PerfCounter(const PerfCounter&) = delete;
+    PerfCounter& operator=(const PerfCounter&) = delete;
+
+    ~PerfCounter() {
+        if (fd != -1)
+            close(fd);
+    }
+
+    bool available() const { return fd != -1; }
+
+    void start() {
+        if (fd != -1) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    long long stop() {
+        long long count = 0;
+        if (fd != -1) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count))
+                count = 0;
+        }
+        return count;
+    }
+
+private:
+    int fd = -1;
+};
+
+// Replays recorded turn frames (the format Snapshot::read() consumes)
+// and times SearchEngine::search() on each of them.
+class Bench {
+public:
+    static int run(int argc, char* argv[]);
+
+private:
+    struct Frame {
+        std::string source;
+        std::string text;
+    };
+
+    struct Config {
+        float timeLimit = 50;
+        int maxDepth = INF;
+        long long maxIterations = INF;
+        SearchEngine::Engine engine = SearchEngine::Engine::BEAM;
+        int repeats = 5;
+        bool listLayers = false;
+        bool verbose = false;
+    };
+
+    struct Summary {
+        long long expanded = 0;
+        long long generated = 0;
+        long long duplicates = 0;
+        long long depth = 0;
+        double time = 0;
+        int searches = 0;
+        std::vector<float> layerTimes;
+        std::vector<float> overshoots;
+        int aborted = 0;
+        int seeded = 0;
+        long long cacheMisses = 0;
+        long long l1Misses = 0;
+        bool countedMisses = false;
+        long long branchMisses = 0;
+        bool countedBranches = false;
+        double depthGained = 0;
+        int comparedFrames = 0;
+
+        double meanDepth() const { return double(depth) / searches; }
+        double expandedPerSecond() const { return expanded / (time / 1000); }
+    };
+
+    static Summary replay(const std::vector<Frame>& frames, const Config& config,
+        const std::map<std::string, float>& baseline);
+    static void replayMcts(const std::vector<Frame>& frames, const Config& config);
+    static void scale(const std::vector<Frame>& frames, Config config, const int& maxThreads);
+    static void microTransitions(const std::vector<Frame>& frames, const int& repeats);
+    static bool checkCarry(const std::vector<Frame>& frames);
+
+    static void usage(const char* name);
+    static bool loadFrames(const char* path, std::vector<Frame>& frames);
+    static bool loadBaseline(const char* path, std::map<std::string, float>& depths);
+    // Returns how long parsing the frame took, in ms, and adds the time
+    // spent on the engine's per-turn tables to prepareTime if given.
+    static float loadFrame(const Frame& frame, float* prepareTime = nullptr);
+    static bool checkParse(const Frame& frame);
+    static float percentile(std::vector<float> values, float p);
+
+    static SearchEngine engine;
+    static Snapshot snapshot;
+
+    static constexpr int ACTION_TOKENS = 11;
+    static constexpr int WITCH_TOKENS = 5;
+};
+
+SearchEngine Bench::engine;
+Snapshot Bench::snapshot;
+
+void Bench::usage(const char* name) {
+    std::cerr << "usage: " << name << " [-e engine] [-t ms] [-d depth] [-i iterations] [-r repeats] [-w width] [-j threads] [-s threads] [-b report] [-l] [-m] [-c] [-u] [-p params] frame-file...\n"
+              << "  -e engine    beam (default), or mcts to compare MCTS against the beam search\n"
+              << "  -t ms        wall-clock budget per search (default 50)\n"
+              << "  -d depth     stop after a fixed depth instead (disables -t)\n"
+              << "  -i iterations  stop MCTS after a fixed number of iterations (disables -t)\n"
+              << "  -r repeats   search every frame this many times (default 5)\n"
+              << "  -w width     beam width (default " << Options::DEFAULTS.beamWidth << ", or beamWidth from -p)\n"
+              << "  -j threads   expand the beam on this many threads (default 1)\n"
+              << "  -s threads   report scaling of throughput from 1 up to this many threads\n"
+              << "  -b report    saved output of an earlier run; report depth gained per frame\n"
+              << "  -l           list duplicate states dropped at every depth of the last search\n"
+              << "  -m           time inventory transitions: packed Delta vs transition table vs DeltaBatch\n"
+              << "  -c           check that states kept for the next turn score as if searched from there\n"
+              << "  -u           frames are consecutive turns: reuse each search in the next one\n"
+              << "  -p params    search parameters, a \"name value\" per line, over WITCH_<NAME> variables\n";
+}
+
+bool Bench::loadFrames(const char* path, std::vector<Frame>& frames) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "bench: cannot open " << path << "\n";
+        return false;
+    }
+
+    std::vector<std::string> tokens;
+    for (std::string token; file >> token; )
+        tokens.push_back(token);
+
+    size_t pos = 0;
+    while (pos < tokens.size()) {
+        int actionCount = std::atoi(tokens[pos].c_str());
+        size_t frameTokens = 1 + size_t(actionCount) * ACTION_TOKENS + 2 * WITCH_TOKENS;
+        if (actionCount < 0 || pos + frameTokens > tokens.size()) {
+            std::cerr << "bench: truncated frame at token " << pos << " in " << path << "\n";
+            return false;
+        }
+
+        Frame frame;
+        frame.source = std::string(path) + "#" + std::to_string(frames.size());
+        for (size_t i = pos; i < pos + frameTokens; ++i)
+            frame.text += tokens[i] + "\n";
+        frames.push_back(std::move(frame));
+        pos += frameTokens;
+    }
+
+    return true;
+}
+
+bool Bench::loadBaseline(const char* path, std::map<std::string, float>& depths) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "bench: cannot open " << path << "\n";
+        return false;
+    }
+
+    for (std::string line; std::getline(file, line); ) {
+        std::istringstream in(line);
+        std::string source;
+        float depth;
+        if (in >> source >> depth && source.find('#') != std::string::npos)
+            depths[source] = depth;
+    }
+
+    return true;
+}
+
+float Bench::loadFrame(const Frame& frame, float* prepareTime) {
+    Reader in(frame.text.data(), frame.text.data() + frame.text.size());
+    Timer timer(0);
+    snapshot.read(in);
+    float parseTime = timer.elapsed();
+
+    engine.load(snapshot);
+    if (prepareTime)
+        *prepareTime += timer.elapsed() - parseTime;
+
+    return parseTime;
+}
+
+// Parses the frame the way the agent once did with std::cin and checks
+// the Reader based parser fills the engine with exactly the same data.
+bool Bench::checkParse(const Frame& frame) {
+    loadFrame(frame);
+
+    std::istringstream in(frame.text);
+    int spellCount = 0, orderCount = 0, recipeCount = 0;
+    bool same = true;
+
+    int actionCount;
+    in >> actionCount;
+    while (actionCount--) {
+        int actionId, price, tomeIndex, taxCount;
+        bool castable, repeatable;
+        std::string actionStr;
+        Delta delta;
+        in >> actionId >> actionStr >> delta >> price >> tomeIndex >> taxCount
+           >> castable >> repeatable;
+
+        if (actionStr == "BREW") {
+            const auto& order = engine.orders[orderCount++];
+            same &= order.id == actionId && order.delta == delta && order.price == price;
+        }
+        else if (actionStr == "CAST") {
+            const auto& spell = engine.spells[spellCount++];
+            Spell expected(actionId, delta, castable, repeatable);
+            same &= spell.id == expected.id && spell.delta == expected.delta &&
+                spell.castable == expected.castable && spell.repeatable == expected.repeatable &&
+                spell.maxTimes == expected.maxTimes;
+        }
+        else if (actionStr == "LEARN") {
+            const auto& recipe = engine.recipes[recipeCount];
+            const auto& spell = engine.spellsFromRecipes[recipeCount++];
+            same &= recipe.id == actionId && recipe.delta == delta &&
+                recipe.tomeIndex == tomeIndex && recipe.taxCount == taxCount &&
+                recipe.repeatable == repeatable && spell.id == actionId && spell.delta == delta;
+        }
+    }
+
+    Witch player, opponent;
+    in >> player >> opponent;
+    same &= spellCount == engine.spellCount && orderCount == engine.orderCount &&
+        recipeCount == engine.recipeCount;
+    same &= player.inv == engine.player.inv && player.score == engine.player.score;
+    same &= opponent.inv == engine.opponent.inv && opponent.score == engine.opponent.score;
+
+    if (!same)
+        std::cerr << "bench: " << frame.source << " parses differently from std::cin\n";
+    return same;
+}
+
+float Bench::percentile(std::vector<float> values, float p) {
+    if (values.empty())
+        return 0;
+    size_t k = std::min(values.size() - 1, size_t(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+int Bench::run(int argc, char* argv[]) {
+    Config config;
+    std::vector<Frame> frames;
+    std::map<std::string, float> baseline;
+    int scaleThreads = 0;
+    bool micro = false;
+    bool carry = false;
+    bool reuse = false;
+    int width = 0;
+
+    if (!Options::loadEnvironment())
+        return 1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "-t") && i + 1 < argc)
+            config.timeLimit = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "-d") && i + 1 < argc) {
+            config.maxDepth = std::atoi(argv[++i]);
+            config.timeLimit = std::numeric_limits<float>::infinity();
+        }
+        else if (!std::strcmp(argv[i], "-i") && i + 1 < argc) {
+            config.maxIterations = std::max(1ll, std::atoll(argv[++i]));
+            config.timeLimit = std::numeric_limits<float>::infinity();
+        }
+        else if (!std::strcmp(argv[i], "-e") && i + 1 < argc) {
+            const char* engine = argv[++i];
+            if (!std::strcmp(engine, "mcts"))
+                config.engine = SearchEngine::Engine::MCTS;
+            else if (std::strcmp(engine, "beam")) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!std::strcmp(argv[i], "-r") && i + 1 < argc)
+            config.repeats = std::max(1, std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "-w") && i + 1 < argc)
+            width = std::max(1, std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "-j") && i + 1 < argc)
+            engine.threadCount = std::max(1, std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "-s") && i + 1 < argc)
+            scaleThreads = std::max(1, std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "-b") && i + 1 < argc) {
+            if (!loadBaseline(argv[++i], baseline))
+                return 1;
+        }
+        else if (!std::strcmp(argv[i], "-l"))
+            config.listLayers = true;
+        else if (!std::strcmp(argv[i], "-m"))
+            micro = true;
+        else if (!std::strcmp(argv[i], "-c"))
+            carry = true;
+        else if (!std::strcmp(argv[i], "-u"))
+            reuse = true;
+        else if (!std::strcmp(argv[i], "-p") && i + 1 < argc) {
+            if (!Options::loadFile(argv[++i]))
+                return 1;
+        }
+        else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        }
+        else if (!loadFrames(argv[i], frames))
+            return 1;
+    }
+
+    if (frames.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+    engine.reuseSearch = reuse;
+    Options::update();
+    engine.setParams(Options::params);
+    if (width)
+        engine.beamWidth = width;
+    if (!Options::isDefault(Options::params)) {
+        std::cout << "parameters:\n";
+        Options::print(std::cout);
+    }
+
+    for (const auto& frame : frames)
+        if (!checkParse(frame))
+            return 1;
+
+    if (micro) {
+        microTransitions(frames, config.repeats);
+        return 0;
+    }
+
+    if (carry)
+        return checkCarry(frames) ? 0 : 1;
+
+    if (scaleThreads > 0) {
+        scale(frames, config, scaleThreads);
+        return 0;
+    }
+
+    if (config.engine == SearchEngine::Engine::MCTS) {
+        if (std::isinf(config.timeLimit) && config.maxIterations == INF) {
+            std::cerr << "bench: MCTS needs -t or -i to stop\n";
+            return 1;
+        }
+        replayMcts(frames, config);
+        return 0;
+    }
+
+    config.verbose = true;
+    Summary summary = replay(frames, config, baseline);
+
+    std::printf("\nsearches: %d, mean depth: %.2f, expanded/s: %.0f, generated/s: %.0f\n",
+        summary.searches, summary.meanDepth(),
+        summary.expandedPerSecond(), summary.generated / (summary.time / 1000));
+    std::printf("duplicates dropped: %lld (%.1f%% of generated)\n",
+        summary.duplicates, 100.0 * summary.duplicates / std::max(1ll, summary.generated));
+    std::printf("layer latency ms: p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",
+        percentile(summary.layerTimes, 0.5f), percentile(summary.layerTimes, 0.9f),
+        percentile(summary.layerTimes, 0.99f), percentile(summary.layerTimes, 1.f));
+    if (!summary.overshoots.empty()) {
+        int late = int(std::count_if(summary.overshoots.begin(), summary.overshoots.end(),
+            [](float overshoot) { return overshoot > 0; }));
+        std::printf("overshoot ms: p50 %+.3f, p90 %+.3f, p99 %+.3f, max %+.3f; "
+            "%d of %d searches late, %d cut a layer short\n",
+            percentile(summary.overshoots, 0.5f), percentile(summary.overshoots, 0.9f),
+            percentile(summary.overshoots, 0.99f), percentile(summary.overshoots, 1.f),
+            late, summary.searches, summary.aborted);
+    }
+    if (summary.countedMisses)
+        std::printf("cache misses per generated state: LLC %.3f, L1d loads %.3f\n",
+            double(summary.cacheMisses) / std::max(1ll, summary.generated),
+            double(summary.l1Misses) / std::max(1ll, summary.generated));
+    else
+        std::printf("cache misses: n/a, hardware counters not available\n");
+    if (summary.countedBranches)
+        std::printf("branch misses per expanded state: %.3f\n",
+            double(summary.branchMisses) / std::max(1ll, summary.expanded));
+    else
+        std::printf("branch misses: n/a, hardware counters not available\n");
+    if (engine.reuseSearch)
+        std::printf("searches seeded from the previous one: %d of %d\n",
+            summary.seeded, summary.searches);
+    if (summary.comparedFrames > 0)
+        std::printf("depth vs baseline: %+.2f on average over %d frames\n",
+            summary.depthGained / summary.comparedFrames, summary.comparedFrames);
+
+    return 0;
+}
+
+Bench::Summary Bench::replay(const std::vector<Frame>& frames, const Config& config,
+    const std::map<std::string, float>& baseline) {
+
+    Summary summary;
+    PerfCounter cacheMisses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    PerfCounter l1Misses(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+        PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    summary.countedMisses = cacheMisses.available() && l1Misses.available();
+    PerfCounter branchMisses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    summary.countedBranches = branchMisses.available();
+
+    if (config.verbose)
+        std::printf("%-24s %6s %10s %10s %6s %9s %12s %8s %8s %8s %8s %8s  %s\n",
+            "frame", "depth", "expanded", "generated", "dup%", "ms", "expanded/s",
+            "p50", "p90", "p99", "parse us", "prep us", "action");
+
+    for (const auto& frame : frames) {
+        std::vector<float> frameLayerTimes;
+        long long expanded = 0, generated = 0, duplicates = 0, depth = 0;
+        double time = 0;
+        float parseTime = 0, prepareTime = 0;
+        const Action* action = nullptr;
+
+        for (int r = 0; r < config.repeats; ++r) {
+            parseTime += loadFrame(frame, &prepareTime);
+            cacheMisses.start();
+            l1Misses.start();
+            branchMisses.start();
+            Timer timer(0);
+            action = engine.search(config.timeLimit, config.maxDepth);
+            time += timer.elapsed();
+            summary.branchMisses += branchMisses.stop();
+            summary.l1Misses += l1Misses.stop();
+            summary.cacheMisses += cacheMisses.stop();
+
+            const auto& stats = engine.stats;
+            expanded += stats.expanded;
+            generated += stats.generated;
+            duplicates += stats.duplicates;
+            depth += stats.depth;
+            frameLayerTimes.insert(frameLayerTimes.end(),
+                stats.layerTimes.begin(), stats.layerTimes.end());
+            summary.aborted += stats.aborted;
+            summary.seeded += stats.seeded > 0;
+            if (config.maxDepth == INF)
+                summary.overshoots.push_back(stats.overshoot);
+        }
+
+        if (config.verbose) {
+            std::printf("%-24s %6.1f %10lld %10lld %6.1f %9.2f %12.0f %8.3f %8.3f %8.3f %8.1f %8.1f  ",
+                frame.source.c_str(), double(depth) / config.repeats,
+                expanded / config.repeats, generated / config.repeats,
+                100.0 * duplicates / std::max(1ll, generated), time / config.repeats,
+                expanded / (time / 1000),
+                percentile(frameLayerTimes, 0.5f),
+                percentile(frameLayerTimes, 0.9f),
+                percentile(frameLayerTimes, 0.99f),
+                parseTime * 1000 / config.repeats, prepareTime * 1000 / config.repeats);
+            std::fflush(stdout);
+            action->print(std::cout);
+        }
+
+        if (config.listLayers) {
+            const auto& layerDuplicates = engine.stats.layerDuplicates;
+            std::printf("  duplicates by depth:");
+            for (int d = 0; d < int(layerDuplicates.size()); ++d)
+                std::printf("%s%d", d % 16 ? " " : "\n   ", layerDuplicates[d]);
+            std::printf("\n");
+        }
+
+        summary.expanded += expanded;
+        summary.generated += generated;
+        summary.duplicates += duplicates;
+        summary.time += time;
+        summary.depth += depth;
+        summary.searches += config.repeats;
+        summary.layerTimes.insert(summary.layerTimes.end(),
+            frameLayerTimes.begin(), frameLayerTimes.end());
+
+        auto it = baseline.find(frame.source);
+        if (it != baseline.end()) {
+            summary.depthGained += double(depth) / config.repeats - it->second;
+            ++summary.comparedFrames;
+        }
+    }
+
+    return summary;
+}
+
+// Runs the MCTS search on every frame, then the beam search with the same
+// budget. The MCTS move is scored against the beam's last layer: the gap
+// between the best leaf overall and the best leaf behind the MCTS move.
+void Bench::replayMcts(const std::vector<Frame>& frames, const Config& config) {
+    std::printf("%-24s %10s %8s %6s %9s %12s %7s %9s  %s\n",
+        "frame", "iterations", "nodes", "depth", "ms", "iter/s", "agree%", "regret", "action");
+
+    long long totalIterations = 0;
+    double totalTime = 0, totalRegret = 0;
+    int searches = 0, agreements = 0, scored = 0, pruned = 0, reused = 0;
+    std::vector<float> overshoots;
+
+    for (const auto& frame : frames) {
+        long long iterations = 0, nodes = 0, depth = 0;
+        double time = 0, regret = 0;
+        int frameAgreements = 0, frameScored = 0;
+        const Action* action = nullptr;
+
+        for (int r = 0; r < config.repeats; ++r) {
+            loadFrame(frame);
+            Timer timer(0);
+            action = engine.mcts->search(config.timeLimit, config.maxIterations);
+            time += timer.elapsed();
+
+            const auto& stats = engine.mcts->stats;
+            iterations += stats.iterations;
+            nodes += stats.nodes;
+            depth += stats.depth;
+            reused += stats.reused > 0;
+            if (config.maxIterations == INF)
+                overshoots.push_back(stats.overshoot);
+
+            // -i leaves the beam without a limit: give it the time MCTS took
+            bool unlimited = std::isinf(config.timeLimit) && config.maxDepth == INF;
+            engine.search(unlimited ? stats.time : config.timeLimit, config.maxDepth);
+            const State* leaves = engine.layers[0].states;
+            eval_t best = -std::numeric_limits<eval_t>::infinity(), bestBehind = best;
+            action_id_t beamAction = SearchEngine::NO_ACTION;
+            for (int i = 0; i < engine.stats.width; ++i) {
+                eval_t value = leaves[i].leafEvaluation(engine);
+                if (value > best) {
+                    best = value;
+                    beamAction = leaves[i].firstAction;
+                }
+                if (leaves[i].firstAction == stats.firstAction)
+                    bestBehind = std::max(bestBehind, value);
+            }
+
+            frameAgreements += beamAction == stats.firstAction;
+            if (std::isinf(bestBehind))
+                ++pruned;
+            else {
+                regret += best - bestBehind;
+                ++frameScored;
+            }
+        }
+
+        std::printf("%-24s %10lld %8lld %6.1f %9.2f %12.0f %7.1f %9.2f  ",
+            frame.source.c_str(), iterations / config.repeats, nodes / config.repeats,
+            double(depth) / config.repeats, time / config.repeats, iterations / (time / 1000),
+            100.0 * frameAgreements / config.repeats, frameScored ? regret / frameScored : 0.0);
+        std::fflush(stdout);
+        action->print(std::cout);
+
+        totalIterations += iterations;
+        totalTime += time;
+        totalRegret += regret;
+        searches += config.repeats;
+        agreements += frameAgreements;
+        scored += frameScored;
+    }
+
+    std::printf("\nsearches: %d, iterations/s: %.0f\n", searches,
+        totalIterations / (totalTime / 1000));
+    std::printf("same move as beam: %d of %d; mean regret vs beam leaves %.2f, "
+        "%d moves the beam had pruned\n",
+        agreements, searches, scored ? totalRegret / scored : 0.0, pruned);
+    if (engine.reuseSearch)
+        std::printf("searches starting from the previous tree: %d of %d\n", reused, searches);
+    if (!overshoots.empty())
+        std::printf("overshoot ms: p50 %+.3f, p99 %+.3f, max %+.3f\n",
+            percentile(overshoots, 0.5f), percentile(overshoots, 0.99f),
+            percentile(overshoots, 1.f));
+}
+
+void Bench::scale(const std::vector<Frame>& frames, Config config, const int& maxThreads) {
+    std::printf("%8s %10s %14s %9s\n", "threads", "depth", "expanded/s", "speedup");
+
+    double singleThreaded = 0;
+    for (int threads = 1; threads <= maxThreads; ++threads) {
+        engine.threadCount = threads;
+        Summary summary = replay(frames, config, {});
+        if (threads == 1)
+            singleThreaded = summary.expandedPerSecond();
+        std::printf("%8d %10.2f %14.0f %8.2fx\n", threads, summary.meanDepth(),
+            summary.expandedPerSecond(), summary.expandedPerSecond() / singleThreaded);
+    }
+}
+
+// Searches every frame a few layers deep, wide enough that nothing is
+// pruned, and expands the state the chosen move leads to exhaustively, as
+// the next turn would with the opponent a turn closer to every order.
+// Every state carried over has to score as the best fresh line to it.
+// Then MCTS does the same with the subtree below its chosen move: every
+// kept child has to score as expanding its parent afresh would.
+bool Bench::checkCarry(const std::vector<Frame>& frames) {
+    static constexpr int DEPTH = 4;
+    static constexpr int WIDTH = 1 << 15;
+    static constexpr int ITERATIONS = 20000;
+    engine.reuseSearch = true;
+    engine.beamWidth = WIDTH;
+    long long checked = 0, mismatches = 0;
+    long long treeChecked = 0, treeMismatches = 0;
+    double maxError = 0, maxTreeError = 0;
+
+    for (const auto& frame : frames) {
+        loadFrame(frame);
+        engine.search(std::numeric_limits<float>::infinity(), DEPTH);
+        if (engine.stats.width == WIDTH) {
+            std::cerr << "bench: " << frame.source << " doesn't fit a layer of " << WIDTH << "\n";
+            return false;
+        }
+
+        State root = engine.getInitialState();
+        std::vector<State> layer(engine.maxNeighbors);
+        layer.resize(root.getNeighbors(engine, layer.data()));
+        auto child = std::find_if(layer.begin(), layer.end(),
+            [](const State& s) { return s.key() == engine.carriedKey; });
+        if (child == layer.end())
+            continue;
+
+        State start = *child;
+        start.firstAction = start.secondAction = SearchEngine::NO_ACTION;
+        start.depth = 0;
+        start.gamma = 1;
+        start.evaluation = engine.rootEvaluation(start);
+        start.discounted = 0;
+
+        auto rivalBrewTurns = engine.rivalBrewTurns;
+        for (auto& turns : engine.rivalBrewTurns)
+            if (turns != SearchEngine::UNREACHABLE && turns > 0)
+                --turns;
+
+        std::unordered_map<uint64_t, State> best = { { start.key(), start } };
+        std::vector<State> neighbors(engine.maxNeighbors);
+        for (int d = 1; d < DEPTH; ++d) {
+            std::unordered_map<uint64_t, State> next;
+            for (const auto& entry : best) {
+                int count = entry.second.getNeighbors(engine, neighbors.data());
+                for (int k = 0; k < count; ++k) {
+                    auto it = next.emplace(neighbors[k].key(), neighbors[k]).first;
+                    if (it->second.evaluation < neighbors[k].evaluation)
+                        it->second = neighbors[k];
+                }
+            }
+            std::swap(best, next);
+        }
+        engine.rivalBrewTurns = rivalBrewTurns;
+
+        for (const State& seed : engine.carried) {
+            auto it = best.find(seed.key());
+            double error = it == best.end() ? INF :
+                std::abs(seed.evaluation - it->second.evaluation) /
+                    std::max(1.f, std::abs(it->second.evaluation));
+            maxError = std::max(maxError, error);
+            mismatches += error > 1e-4;
+            ++checked;
+        }
+
+        Mcts& mcts = *engine.mcts;
+        mcts.forget();
+        mcts.search(std::numeric_limits<float>::infinity(), ITERATIONS);
+        start = mcts.states[mcts.played];
+        start.firstAction = start.secondAction = SearchEngine::NO_ACTION;
+        start.depth = 0;
+        start.gamma = 1;
+        start.evaluation = engine.rootEvaluation(start);
+        start.discounted = 0;
+
+        for (auto& turns : engine.rivalBrewTurns)
+            if (turns != SearchEngine::UNREACHABLE && turns > 0)
+                --turns;
+        if (!mcts.reuseTree(start)) {
+            std::cerr << "bench: " << frame.source << " doesn't reuse the MCTS tree\n";
+            return false;
+        }
+
+        // expands the kept subtree again from start, node by node
+        std::vector<std::pair<int, State>> stack = { { mcts.root, start } };
+        while (!stack.empty()) {
+            const Mcts::Node& node = mcts.nodes[stack.back().first];
+            State parent = stack.back().second;
+            stack.pop_back();
+            if (node.childCount == 0)
+                continue;
+
+            parent.firstAction = SearchEngine::TREE_ACTION;
+            parent.secondAction = SearchEngine::NO_ACTION;
+            int count = parent.getNeighbors(engine, neighbors.data());
+            for (int k = 0; k < node.childCount; ++k) {
+                const State& kept = mcts.states[node.firstChild + k];
+                const State& fresh = neighbors[k];
+                double error = count != node.childCount || kept.key() != fresh.key() ||
+                    kept.depth != fresh.depth ? INF :
+                    std::max(std::abs(kept.evaluation - fresh.evaluation) /
+                        std::max(1.f, std::abs(fresh.evaluation)),
+                        std::abs(kept.gamma - fresh.gamma) / fresh.gamma);
+                maxTreeError = std::max(maxTreeError, error);
+                treeMismatches += error > 1e-4;
+                ++treeChecked;
+                if (error <= 1e-4)
+                    stack.emplace_back(node.firstChild + k, fresh);
+            }
+        }
+        engine.rivalBrewTurns = rivalBrewTurns;
+    }
+
+    std::printf("carried states: %lld checked, %lld score differently from a fresh search, "
+        "largest relative error %.2g\n", checked, mismatches, maxError);
+    std::printf("reused MCTS states: %lld checked, %lld score differently from a fresh expansion, "
+        "largest relative error %.2g\n", treeChecked, treeMismatches, maxTreeError);
+    return checked > 0 && mismatches == 0 && treeChecked > 0 && treeMismatches == 0;
+}
+
+// Applies every cast and order of each frame to all 1001 inventories,
+// once with Delta::canApply() and operator+ and once through the
+// transition table, checking both agree. Then times just the legality
+// test, one delta at a time and batched by DeltaBatch.
+void Bench::microTransitions(const std::vector<Frame>& frames, const int& repeats) {
+    static constexpr int ROUNDS = 200;
+    double packedTime = 0, tableTime = 0, scalarTime = 0, batchTime = 0;
+    long long transitions = 0, mismatches = 0;
+    uint64_t sink = 0;
+
+    for (const auto& frame : frames) {
+        loadFrame(frame);
+
+        const auto& deltas = engine.slotDeltas;
+        const auto& batch = engine.slotBatch;
+        int slotCount = int(deltas.size());
+        std::vector<uint64_t> applicable(batch.maskWords());
+
+        for (inv_t inv = 0; inv < Inventory::COUNT; ++inv) {
+            const Delta& from = Inventory::delta(inv);
+            const inv_t* row = engine.transitionRow(inv);
+            batch.applicable(from, applicable.data());
+            for (int k = 0; k < slotCount; ++k) {
+                bool legal = from.canApply(deltas[k]);
+                inv_t expected = legal ? Inventory::index(from + deltas[k]) : Inventory::NONE;
+                mismatches += row[k] != expected;
+                mismatches += bool(applicable[k / 64] >> (k % 64) & 1) != legal;
+            }
+        }
+
+        for (int r = 0; r < repeats; ++r) {
+            Timer packed(0);
+            for (int round = 0; round < ROUNDS; ++round)
+                for (inv_t inv = 0; inv < Inventory::COUNT; ++inv) {
+                    const Delta& from = Inventory::delta(inv);
+                    for (int k = 0; k < slotCount; ++k)
+                        if (from.canApply(deltas[k]))
+                            sink += (from + deltas[k]).packed;
+                }
+            packedTime += packed.elapsed();
+
+            Timer table(0);
+            for (int round = 0; round < ROUNDS; ++round)
+                for (inv_t inv = 0; inv < Inventory::COUNT; ++inv) {
+                    const inv_t* row = engine.transitionRow(inv);
+                    for (int k = 0; k < slotCount; ++k)
+                        if (row[k] != Inventory::NONE)
+                            sink += row[k];
+                }
+            tableTime += table.elapsed();
+
+            Timer scalar(0);
+            for (int round = 0; round < ROUNDS; ++round)
+                for (inv_t inv = 0; inv < Inventory::COUNT; ++inv) {
+                    const Delta& from = Inventory::delta(inv);
+                    for (int k = 0; k < slotCount; ++k)
+                        sink += from.canApply(deltas[k]);
+                }
+            scalarTime += scalar.elapsed();
+
+            Timer batched(0);
+            for (int round = 0; round < ROUNDS; ++round)
+                for (inv_t inv = 0; inv < Inventory::COUNT; ++inv) {
+                    batch.applicable(Inventory::delta(inv), applicable.data());
+                    for (const auto& mask : applicable)
+                        sink += __builtin_popcountll(mask);
+                }
+            batchTime += batched.elapsed();
+
+            transitions += (long long)ROUNDS * Inventory::COUNT * slotCount;
+        }
+    }
+
+    std::printf("transitions: %lld, mismatches: %lld (checksum %llu)\n",
+        transitions, mismatches, (unsigned long long)(sink & 0xff));
+    std::printf("packed Delta: %.3f ns per transition\n", packedTime * 1e6 / transitions);
+    std::printf("table lookup: %.3f ns per transition\n", tableTime * 1e6 / transitions);
+    std::printf("legality, canApply one by one: %.3f ns per delta\n",
+        scalarTime * 1e6 / transitions);
+    std::printf("legality, %s DeltaBatch: %.3f ns per delta\n",
+        DeltaBatch::kernel(), batchTime * 1e6 / transitions);
+}
+
+int main(int argc, char* argv[]) {
+    return Bench::run(argc, argv);
+}
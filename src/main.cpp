@@ -1,9 +1,47 @@
-#include "Battle.hpp"
+#include "SearchEngine.hpp"
+#include "Options.hpp"
+#include "Reader.hpp"
+#include "Snapshot.hpp"
 
-int main() {
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// The agent: answers every frame the referee writes on stdin with the
+// engine's decision on stdout.
+int main(int argc, char* argv[]) {
 	std::ios_base::sync_with_stdio(false);
-	
-    Battle::start();
 
-    return 0;
+	static SearchEngine engine;
+	Options::loadEnvironment();
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!std::strcmp(argv[i], "-T"))
+			engine.firstTurnTimeLimit = std::atof(argv[i + 1]);
+		else if (!std::strcmp(argv[i], "-t"))
+			engine.turnTimeLimit = std::atof(argv[i + 1]);
+		else if (!std::strcmp(argv[i], "-e"))
+			engine.engine = std::strcmp(argv[i + 1], "mcts") ?
+				SearchEngine::Engine::BEAM : SearchEngine::Engine::MCTS;
+		else if (!std::strcmp(argv[i], "-p"))
+			Options::loadFile(argv[i + 1]);
+		// workers expanding each layer, one by default
+		else if (!std::strcmp(argv[i], "-j"))
+			engine.threadCount = std::max(1, std::atoi(argv[i + 1]));
+	}
+	Options::update();
+	engine.setParams(Options::params);
+
+	static Reader input(0);
+	Snapshot snapshot;
+	while (!input.eof()) {
+		// eof() waits for the turn's first byte
+		auto received = Timer::Clock::now();
+		snapshot.read(input);
+		Decision decision = engine.decide(snapshot, received);
+		decision.action->print(std::cout);
+		engine.report(decision);
+		Log::flush();
+	}
+
+	return 0;
 }
@@ -0,0 +1,292 @@
+#include "SearchEngine.hpp"
+#include "Options.hpp"
+#include "Referee.hpp"
+#include "Snapshot.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Tunes the search parameters with SPSA: every iteration plays the
+// current parameters nudged one way against the same nudged the other way
+// and moves towards whichever side won more. Games are played on worker
+// threads, one a core, each with a SearchEngine for either player.
+class Tuner {
+public:
+    static int run(int argc, char* argv[]);
+
+private:
+    struct Parameter {
+        const char* name;
+        float Options::Params::* value;
+        float min;
+        float max;
+    };
+
+    static const Parameter PARAMETERS[];
+
+    struct Config {
+        int iterations = 100;
+        int games = 32;
+        int workers = 1;
+        uint32_t seed = 1;
+        float turnTime = 5;
+        bool mcts = false;
+        const char* output = nullptr;
+    };
+
+    struct Job {
+        Options::Params params[Referee::PLAYER_COUNT];
+        uint32_t seed;
+    };
+
+    struct Result {
+        int result;
+        int rounds;
+    };
+
+    using Seats = std::unique_ptr<SearchEngine[]>;
+
+    // Spall's recommended decay of the gain and perturbation sequences,
+    // with steps and perturbations measured in fractions of each range.
+    static constexpr double ALPHA = 0.602;
+    static constexpr double GAMMA = 0.101;
+    static constexpr double PERTURBATION = 0.1;
+    static constexpr double FIRST_STEP = 0.05;
+
+    static Result play(SearchEngine* engines, const Job& job);
+    static void playBatch(std::vector<Seats>& seats, const std::vector<Job>& jobs,
+        std::vector<Result>& results);
+    static void write(std::ostream& out, const Config& config, const Options::Params& params);
+    static void usage(const char* name);
+};
+
+const Tuner::Parameter Tuner::PARAMETERS[] = {
+    { "decay", &Options::Params::decay, 0.85f, 0.999f },
+    { "learnDecay", &Options::Params::learnDecay, 0.2f, 1 },
+    { "nearOrderWeight", &Options::Params::nearOrderWeight, 0, 1 },
+    { "rivalDiscount", &Options::Params::rivalDiscount, 0, 1 },
+    { "castableValue", &Options::Params::castableValue, 0, 0.1f },
+    { "exploration", &Options::Params::exploration, 0.2f, 3 },
+};
+
+void Tuner::usage(const char* name) {
+    std::cerr << "usage: " << name << " [-n iterations] [-g games] [-j workers] [-s seed] [-t ms] [-e engine] [-p params] [-o file]\n"
+              << "  -n iterations  SPSA iterations (default 100)\n"
+              << "  -g games     games per iteration, each seed from both sides (default 32)\n"
+              << "  -j workers   worker threads, one a core (default 1)\n"
+              << "  -s seed      seed of the first game (default 1)\n"
+              << "  -t ms        search time every turn, the first one included (default 5)\n"
+              << "  -e engine    beam (default), or mcts, which also tunes exploration\n"
+              << "  -p params    start from these parameters instead of the defaults\n"
+              << "  -o file      also write the result there, for the agent's -p\n";
+}
+
+// Every engine plays one side of the game from start to end.
+Tuner::Result Tuner::play(SearchEngine* engines, const Job& job) {
+    Referee referee(job.seed);
+    Snapshot snapshot;
+    for (int p = 0; p < Referee::PLAYER_COUNT; ++p) {
+        engines[p].setParams(job.params[p]);
+        engines[p].newGame();
+    }
+
+    while (!referee.isOver()) {
+        std::string lines[Referee::PLAYER_COUNT];
+        for (int p = 0; p < Referee::PLAYER_COUNT; ++p) {
+            std::string frame = referee.frame(p);
+            Reader in(frame.data(), frame.data() + frame.size());
+            snapshot.read(in);
+
+            std::ostringstream out;
+            engines[p].decide(snapshot).action->print(out);
+            lines[p] = out.str();
+        }
+        referee.play(lines);
+    }
+
+    return { referee.result(0), referee.round() };
+}
+
+// Each worker takes the next game as soon as it's done with one.
+void Tuner::playBatch(std::vector<Seats>& seats, const std::vector<Job>& jobs,
+    std::vector<Result>& results) {
+
+    results.assign(jobs.size(), Result());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    for (auto& engines : seats)
+        threads.emplace_back([&jobs, &results, &next, &engines] {
+            for (size_t i = next++; i < jobs.size(); i = next++)
+                results[i] = play(engines.get(), jobs[i]);
+        });
+    for (auto& thread : threads)
+        thread.join();
+}
+
+void Tuner::write(std::ostream& out, const Config& config, const Options::Params& params) {
+    out << "# tuned on " << config.iterations << " x " << config.games << " games of "
+        << config.turnTime << " ms turns\n";
+    for (const auto& p : PARAMETERS)
+        if (config.mcts || p.value != &Options::Params::exploration)
+            out << p.name << " " << params.*p.value << "\n";
+}
+
+int Tuner::run(int argc, char* argv[]) {
+    Config config;
+    if (!Options::loadEnvironment())
+        return 1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+            config.iterations = std::max(1, std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "-g") && i + 1 < argc)
+            config.games = std::max(2, std::atoi(argv[++i]) / 2 * 2);
+        else if (!std::strcmp(argv[i], "-j") && i + 1 < argc)
+            config.workers = std::max(1, std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "-s") && i + 1 < argc)
+            config.seed = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+        else if (!std::strcmp(argv[i], "-t") && i + 1 < argc)
+            config.turnTime = std::max(0.1f, float(std::atof(argv[++i])));
+        else if (!std::strcmp(argv[i], "-e") && i + 1 < argc) {
+            const char* engine = argv[++i];
+            config.mcts = !std::strcmp(engine, "mcts");
+            if (!config.mcts && std::strcmp(engine, "beam")) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!std::strcmp(argv[i], "-p") && i + 1 < argc) {
+            if (!Options::loadFile(argv[++i]))
+                return 1;
+        }
+        else if (!std::strcmp(argv[i], "-o") && i + 1 < argc)
+            config.output = argv[++i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<Seats> seats;
+    for (int i = 0; i < config.workers; ++i) {
+        seats.emplace_back(new SearchEngine[Referee::PLAYER_COUNT]);
+        for (int p = 0; p < Referee::PLAYER_COUNT; ++p) {
+            SearchEngine& engine = seats.back()[p];
+            engine.firstTurnTimeLimit = engine.turnTimeLimit = config.turnTime;
+            // moves go straight to the in-process referee: there's no pipe
+            // or process start to leave time for, and a margin as large as
+            // these turns would leave the search nothing
+            engine.deadlineMargin = 0;
+            engine.engine = config.mcts ? SearchEngine::Engine::MCTS : SearchEngine::Engine::BEAM;
+        }
+    }
+
+    std::vector<const Parameter*> tuned;
+    for (const auto& p : PARAMETERS)
+        if (config.mcts || p.value != &Options::Params::exploration)
+            tuned.push_back(&p);
+
+    // position of every tuned parameter within its range
+    Options::Params base = Options::params;
+    std::vector<double> theta;
+    for (const auto* p : tuned)
+        theta.push_back(std::clamp(double(base.*p->value - p->min) / (p->max - p->min), 0., 1.));
+    auto paramsAt = [&](const std::vector<double>& at) {
+        Options::Params params = base;
+        for (size_t i = 0; i < tuned.size(); ++i)
+            params.*tuned[i]->value = float(tuned[i]->min +
+                std::clamp(at[i], 0., 1.) * (tuned[i]->max - tuned[i]->min));
+        return params;
+    };
+
+    // the first step moves FIRST_STEP for a quarter of the games' margin
+    double stability = config.iterations / 10.;
+    double gain = FIRST_STEP * std::pow(stability + 1, ALPHA) * 2 * PERTURBATION / 0.25;
+
+    std::mt19937 rng(config.seed);
+    uint32_t seed = config.seed;
+    long long totalGames = 0;
+    Timer total(0);
+
+    for (int k = 0; k < config.iterations; ++k) {
+        double a = gain / std::pow(k + 1 + stability, ALPHA);
+        double c = PERTURBATION / std::pow(k + 1, GAMMA);
+
+        std::vector<double> delta(tuned.size()), plus(theta), minus(theta);
+        for (size_t i = 0; i < tuned.size(); ++i) {
+            delta[i] = rng() & 1 ? 1 : -1;
+            plus[i] += c * delta[i];
+            minus[i] -= c * delta[i];
+        }
+        Options::Params plusParams = paramsAt(plus), minusParams = paramsAt(minus);
+
+        // even games have the plus side as player 0, odd ones swap sides
+        std::vector<Job> jobs(config.games);
+        for (int g = 0; g < config.games; ++g) {
+            jobs[g].params[g % 2] = plusParams;
+            jobs[g].params[1 - g % 2] = minusParams;
+            jobs[g].seed = seed + g / 2;
+        }
+        seed += config.games / 2;
+
+        Timer timer(0);
+        std::vector<Result> results;
+        playBatch(seats, jobs, results);
+        float time = timer.elapsed();
+        totalGames += config.games;
+
+        double plusScore = 0;
+        long long rounds = 0;
+        for (int g = 0; g < config.games; ++g) {
+            int r = results[g].result;
+            plusScore += r == -1 ? 0.5 : g % 2 ? 1 - r : r;
+            rounds += results[g].rounds;
+        }
+        double margin = 2 * plusScore / config.games - 1;
+
+        for (size_t i = 0; i < tuned.size(); ++i)
+            theta[i] = std::clamp(theta[i] + a * margin / (2 * c * delta[i]), 0., 1.);
+
+        Options::Params current = paramsAt(theta);
+        std::printf("iteration %d: plus scored %.3f, %.1f rounds, %.2f games/s, %.3f games/s per core\n ",
+            k + 1, plusScore / config.games, double(rounds) / config.games,
+            config.games / (time / 1000), config.games / (time / 1000) / config.workers);
+        for (const auto* p : tuned)
+            std::printf(" %s %.4f", p->name, current.*p->value);
+        std::printf("\n");
+        std::fflush(stdout);
+    }
+
+    float time = total.elapsed();
+    std::printf("\n%lld games in %.1f s: %.2f games/s, %.3f games/s per core\n\n", totalGames,
+        time / 1000, totalGames / (time / 1000), totalGames / (time / 1000) / config.workers);
+
+    Options::Params result = paramsAt(theta);
+    write(std::cout, config, result);
+    if (config.output) {
+        std::ofstream file(config.output);
+        write(file, config, result);
+        if (!file) {
+            std::cerr << "tuner: cannot write " << config.output << "\n";
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    return Tuner::run(argc, argv);
+}